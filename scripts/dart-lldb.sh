@@ -28,6 +28,7 @@ REMOTE_ARGS=""
 REMOTE_HOST=""
 SYSROOT=""
 PENDING_BREAKPOINTS=""
+PENDING_BREAKPOINTS_FILE=""
 ARGS=()
 TARGET_BINARY=""
 
@@ -57,6 +58,14 @@ while [[ $# -gt 0 ]]; do
             PENDING_BREAKPOINTS="$2"
             shift 2
             ;;
+        --pending-breakpoints-file)
+            if [[ -z "$2" || "$2" == --* ]]; then
+                echo "Error: --pending-breakpoints-file requires a PATH argument"
+                exit 1
+            fi
+            PENDING_BREAKPOINTS_FILE="$(readlink -f "$2")"
+            shift 2
+            ;;
         --help)
             echo "Usage: dart-lldb [options] [dart_binary] [dart_args...]"
             echo ""
@@ -65,6 +74,9 @@ while [[ $# -gt 0 ]]; do
             echo "  --sysroot PATH            Set the sysroot for remote debugging"
             echo "  --pending-breakpoints LIST Set pending breakpoints for JIT functions"
             echo "                            (function names separated by semicolons)"
+            echo "  --pending-breakpoints-file PATH"
+            echo "                            Load pending breakpoints from a file"
+            echo "                            (one exact name or glob pattern per line)"
             echo "  --help                    Show this help message"
             echo ""
             echo "Examples:"
@@ -95,6 +107,9 @@ make_watch_cmds () {
       [ -z "$pat" ] && continue
       cmds="$cmds -o \"dart-jit watch $pat\""
   done
+  if [ -n "$PENDING_BREAKPOINTS_FILE" ]; then
+      cmds="$cmds -o \"dart-jit watch --from-file \\\"$PENDING_BREAKPOINTS_FILE\\\"\""
+  fi
   echo "$cmds"
 }
 
@@ -125,8 +140,8 @@ if [ -n "$REMOTE_HOST" ]; then
     REMOTE_ARGS="$REMOTE_ARGS -o \"dart_jit_setup\""
 
     # For pending breakpoints, we'll add them directly to the global variable
-    if [ -n "$PENDING_BREAKPOINTS" ]; then
-        echo "Installing pending breakpoints (remote): $PENDING_BREAKPOINTS"
+    if [ -n "$PENDING_BREAKPOINTS" ] || [ -n "$PENDING_BREAKPOINTS_FILE" ]; then
+        echo "Installing pending breakpoints (remote): $PENDING_BREAKPOINTS $PENDING_BREAKPOINTS_FILE"
         WATCH_CMDS=$(make_watch_cmds "$PENDING_BREAKPOINTS")
         REMOTE_ARGS="$REMOTE_ARGS $WATCH_CMDS"
     fi
@@ -151,8 +166,8 @@ else
         LLDB_CMD="$LLDB_CMD -o \"dart_jit_setup\""
         
         # For pending breakpoints, we'll add them directly to the global variable
-        if [ -n "$PENDING_BREAKPOINTS" ]; then
-            echo "Installing pending breakpoints: $PENDING_BREAKPOINTS"
+        if [ -n "$PENDING_BREAKPOINTS" ] || [ -n "$PENDING_BREAKPOINTS_FILE" ]; then
+            echo "Installing pending breakpoints: $PENDING_BREAKPOINTS $PENDING_BREAKPOINTS_FILE"
             WATCH_CMDS=$(make_watch_cmds "$PENDING_BREAKPOINTS")
             LLDB_CMD="$LLDB_CMD $WATCH_CMDS"
         fi
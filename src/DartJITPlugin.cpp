@@ -7,6 +7,8 @@
 #include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <sstream>
 #include <string>
@@ -16,6 +18,41 @@
 #include <cinttypes>
 #include <algorithm>
 #include <cctype>
+#include <cmath>
+#include <cstring>
+#include <fnmatch.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <tuple>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#ifdef __linux__
+#include <cerrno>
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Static tracepoints (USDT/SDT) in the registration pipeline, for bpftrace
+// or perf. Each one is a single nop until a tracer attaches to it.
+#ifdef DART_JIT_ENABLE_SDT
+#include <sys/sdt.h>
+#define DART_JIT_PROBE1(name, a) DTRACE_PROBE1(dartjit, name, a)
+#define DART_JIT_PROBE2(name, a, b) DTRACE_PROBE2(dartjit, name, a, b)
+#define DART_JIT_PROBE3(name, a, b, c) DTRACE_PROBE3(dartjit, name, a, b, c)
+#else
+#define DART_JIT_PROBE1(name, a) do {} while (0)
+#define DART_JIT_PROBE2(name, a, b) do {} while (0)
+#define DART_JIT_PROBE3(name, a, b, c) do {} while (0)
+#endif
 
 using namespace lldb;
 
@@ -23,11 +60,151 @@ using namespace lldb;
 static std::mutex g_jit_mutex;
 static std::unordered_map<uint64_t, std::string> g_jit_functions;
 static std::unordered_map<uint64_t, std::string> g_jit_files;
-static std::unordered_map<uint64_t, uint64_t> g_jit_sizes;
+static std::map<uint64_t, uint64_t> g_jit_sizes;  // ordered for PC lookups
+static std::unordered_map<uint64_t, uint64_t> g_jit_thread_ids;
+static std::unordered_map<std::string, uint32_t> g_jit_name_versions;  // registrations per name
+
+// Payload keys beyond name/start/size/file (tier, kind, isolate, ...), kept
+// as interned (key, value) string ids. Entries without extra keys have no
+// side-table entry at all. Guarded by g_jit_mutex.
+typedef std::vector<std::pair<uint32_t, uint32_t>> JITAttrs;
+typedef std::vector<std::pair<std::string, std::string>> JITAttrList;
+static std::vector<std::string> g_attr_strings;
+static std::unordered_map<std::string, uint32_t> g_attr_ids;
+static std::unordered_map<uint64_t, JITAttrs> g_jit_attrs;
+
+// Registration totals per registering thread (compiler vs mutator)
+struct JITThreadStats {
+  std::string name;
+  uint64_t registrations = 0;
+  uint64_t bytes = 0;
+  uint64_t stop_ns = 0;
+  uint64_t stops = 0;
+};
+static std::unordered_map<uint64_t, JITThreadStats> g_jit_thread_stats;
 
-static std::vector<std::string>           g_pending_patterns;
+static std::mutex                         g_pending_mutex;
+static std::vector<std::string>           g_pending_patterns;  // lowercased substrings
+static std::vector<std::string>           g_pending_globs;
+static std::unordered_set<std::string>    g_pending_exact;
 static std::unordered_set<lldb::addr_t>   g_active_bp_addrs;
 
+// Allocation profiler: one baton per instrumented allocation stub, and
+// allocation counts keyed by (class, call site)
+struct AllocStub {
+  uint64_t addr;
+  std::string class_name;  // empty for generic stubs that take a tags register
+  break_id_t bp_id;
+};
+static std::mutex g_alloc_mutex;
+static bool g_allocprof_active = false;
+static std::string g_allocprof_pattern = "Allocate";
+static std::string g_allocprof_tags_reg;  // chosen per ABI at start
+static std::vector<std::unique_ptr<AllocStub>> g_alloc_stubs;
+static std::map<std::pair<std::string, uint64_t>, uint64_t> g_alloc_counts;
+
+// Deoptimization tracker: hits on the VM's deopt entry points, attributed
+// to the optimized JIT function being deoptimized (keyed by name so counts
+// survive recompilation)
+struct DeoptStats {
+  uint64_t count = 0;
+  std::unordered_set<uint64_t> code_addrs;
+};
+static std::mutex g_deopt_mutex;
+static std::vector<break_id_t> g_deopt_bp_ids;
+static std::unordered_map<std::string, DeoptStats> g_deopt_stats;
+static uint64_t g_deopt_unattributed = 0;
+
+// Timeline of registrations and GC pauses, in microseconds since the plugin
+// was loaded, exportable as a Chrome trace
+struct TimelineEvent {
+  std::string category;
+  std::string name;
+  uint64_t tid;
+  uint64_t ts_us;
+  uint64_t dur_us;
+  uint64_t addr;
+  uint64_t size;
+};
+static const std::chrono::steady_clock::time_point g_session_start =
+    std::chrono::steady_clock::now();
+static std::mutex g_timeline_mutex;
+static std::vector<TimelineEvent> g_timeline;
+
+// GC pause tracking: entry breakpoints on the collector entry points, plus a
+// one-shot breakpoint on each pending call's return address (per thread)
+struct GCPendingPause {
+  std::string kind;
+  uint64_t ts_us;
+  break_id_t exit_bp_id;
+};
+static std::mutex g_gc_mutex;
+static std::vector<break_id_t> g_gc_bp_ids;
+static std::vector<std::unique_ptr<std::string>> g_gc_kinds;
+static std::unordered_map<uint64_t, std::vector<GCPendingPause>> g_gc_pending;
+static std::map<std::string, std::vector<uint64_t>> g_gc_pauses_us;
+
+// Compile latency: start times of in-flight compiles per thread (nested
+// compiles stack up) and the measured latency per registered function
+static std::mutex g_compile_mutex;
+static std::vector<break_id_t> g_compile_bp_ids;
+static std::unordered_map<uint64_t, std::vector<std::chrono::steady_clock::time_point>> g_compile_starts;
+static std::unordered_map<uint64_t, uint64_t> g_compile_us;
+
+// Per-breakpoint cost of the breakpoints the plugin owns (dart-jit bpcost):
+// the name each was created under, and hits, auto-continues and callback
+// time for those with plugin callbacks.
+struct BreakpointCost {
+  uint64_t hits = 0;
+  uint64_t auto_continues = 0;
+  uint64_t callback_ns = 0;
+};
+static std::mutex g_bpcost_mutex;
+static std::unordered_map<break_id_t, std::string> g_owned_bps;
+static std::unordered_map<break_id_t, BreakpointCost> g_bp_costs;
+static std::map<std::string, BreakpointCost> g_retired_bp_costs;  // deleted one-shots, by owner
+
+// Lock-free counters for live monitoring (dart-jit top). Every plugin
+// callback is a stop of the inferior; they are counted by cause.
+enum StopCause {
+  kStopRegister,
+  kStopAlloc,
+  kStopDeopt,
+  kStopGC,
+  kStopCompile,
+  kNumStopCauses
+};
+static const char *const kStopCauseNames[kNumStopCauses] = {
+    "register", "alloc", "deopt", "gc", "compile"};
+static std::atomic<uint64_t> g_stat_registrations(0);
+static std::atomic<uint64_t> g_stat_code_bytes(0);
+static std::atomic<uint64_t> g_stat_registry_bytes(0);
+static std::atomic<uint64_t> g_stat_stops[kNumStopCauses];
+static std::atomic<uint64_t> g_stat_callback_ns[kNumStopCauses];
+
+// Low-rate PC sampling, piggybacked on the stops the plugin already takes:
+// at most one sample of every thread per interval, counted per JIT function.
+// Time spent sampling is kept apart from callback time.
+static std::atomic<uint64_t> g_sample_interval_us(100000);
+static std::atomic<uint64_t> g_last_sample_us(0);
+static std::mutex g_sample_mutex;
+static std::unordered_map<uint64_t, uint64_t> g_hot_samples;
+static std::atomic<uint64_t> g_stat_samples(0);
+static std::atomic<uint64_t> g_stat_sample_ns(0);
+
+// Sampling profile being recorded: folded stacks (root first, ';'-separated
+// function names) with sample counts, so runs can be compared by name. Has
+// its own interval so 'profile start' does not change what top samples.
+static std::atomic<bool> g_profile_recording(false);
+static std::atomic<uint64_t> g_profile_interval_us(100000);
+static std::atomic<uint64_t> g_last_profile_us(0);
+static std::unordered_map<std::string, uint64_t> g_profile_stacks;
+
+// Dart class id -> class name, filled lazily from the VM's debug info
+static std::mutex g_class_name_mutex;
+static std::unordered_map<uint32_t, std::string> g_class_names;
+static bool g_class_names_loaded = false;
+
 // Helper: did we already add a bp at this address?
 static bool AlreadyPatched(lldb::addr_t addr) {
   return g_active_bp_addrs.find(addr) != g_active_bp_addrs.end();
@@ -35,15 +212,28 @@ static bool AlreadyPatched(lldb::addr_t addr) {
 
 // Helper: does a function name match any pending pattern?
 static bool MatchesPending(const std::string &fn) {
+  std::lock_guard<std::mutex> lock(g_pending_mutex);
+
+  // Exact names (watch lists loaded from files) are a single hash lookup
+  if (g_pending_exact.count(fn)) {
+    return true;
+  }
+
+  for (const auto &glob : g_pending_globs) {
+    if (fnmatch(glob.c_str(), fn.c_str(), 0) == 0) {
+      return true;
+    }
+  }
+
+  if (g_pending_patterns.empty()) {
+    return false;
+  }
+
   // Convert function name to lowercase for case-insensitive matching
   std::string fn_lower = fn;
   std::transform(fn_lower.begin(), fn_lower.end(), fn_lower.begin(), ::tolower);
   
-  for (const auto &pat : g_pending_patterns) {
-    // Convert pattern to lowercase for case-insensitive matching
-    std::string pat_lower = pat;
-    std::transform(pat_lower.begin(), pat_lower.end(), pat_lower.begin(), ::tolower);
-    
+  for (const auto &pat_lower : g_pending_patterns) {
     if (fn_lower.find(pat_lower) != std::string::npos) {
       return true;
     }
@@ -51,11 +241,413 @@ static bool MatchesPending(const std::string &fn) {
   return false;
 }
 
+// Helper: find a registered function by name. An exact match wins, otherwise
+// the first function containing the name is used (same rule as dart-jit break).
+static bool FindJITFunctionByName(const std::string &query, uint64_t &addr,
+                                  uint64_t &size, std::string &name) {
+  std::lock_guard<std::mutex> lock(g_jit_mutex);
+  const std::pair<const uint64_t, std::string> *partial = nullptr;
+  for (const auto &pair : g_jit_functions) {
+    if (pair.second == query) {
+      partial = &pair;
+      break;
+    }
+    if (!partial && pair.second.find(query) != std::string::npos) {
+      partial = &pair;
+    }
+  }
+  if (!partial) {
+    return false;
+  }
+  addr = partial->first;
+  name = partial->second;
+  size = g_jit_sizes[addr];
+  return true;
+}
+
+// Helper: target of a direct branch or call. LLDB prints direct targets as
+// a bare absolute hex address in the last operand (after the register and
+// bit operands of cbz/tbz on arm64). Memory, register and indirect operands
+// are rejected even when they print a displacement, in either x86 syntax:
+// call qword ptr [r14 + 0x8], callq *0x8(%r14), jmp rcx.
+static bool ParseDirectBranchTarget(const char *operands, uint64_t &target) {
+  if (!operands || strpbrk(operands, "[*(%") != nullptr) {
+    return false;
+  }
+  const char *last = strrchr(operands, ',');
+  last = last ? last + 1 : operands;
+  while (isspace(static_cast<unsigned char>(*last))) {
+    ++last;
+  }
+  if (strncmp(last, "0x", 2) != 0) {
+    return false;
+  }
+  char *end = nullptr;
+  uint64_t value = strtoull(last, &end, 16);
+  if (end == last + 2) {
+    return false;
+  }
+  while (isspace(static_cast<unsigned char>(*end))) {
+    ++end;
+  }
+  if (*end != '\0') {
+    return false;
+  }
+  target = value;
+  return true;
+}
+
+// Helper: is this registered name a VM stub or trampoline rather than a
+// compiled Dart function?
+static bool IsStubName(const std::string &name) {
+  return name.find("Stub") != std::string::npos ||
+         name.find("stub") != std::string::npos ||
+         name.find("Trampoline") != std::string::npos;
+}
+
+// Helper: id of an attribute key or value, adding it on first use.
+// Caller must hold g_jit_mutex.
+static uint32_t InternAttrLocked(const std::string &str) {
+  auto it = g_attr_ids.find(str);
+  if (it != g_attr_ids.end()) {
+    return it->second;
+  }
+  uint32_t id = static_cast<uint32_t>(g_attr_strings.size());
+  g_attr_strings.push_back(str);
+  g_attr_ids.emplace(str, id);
+  return id;
+}
+
+// Helper: replace the attributes of a registry entry.
+// Caller must hold g_jit_mutex.
+static void SetJITAttrsLocked(uint64_t addr, const JITAttrList &attrs) {
+  if (attrs.empty()) {
+    g_jit_attrs.erase(addr);
+    return;
+  }
+  JITAttrs &ids = g_jit_attrs[addr];
+  ids.clear();
+  ids.reserve(attrs.size());
+  for (const auto &attr : attrs) {
+    ids.emplace_back(InternAttrLocked(attr.first), InternAttrLocked(attr.second));
+  }
+}
+
+// Helper: look up one attribute of a registry entry. The built-in name and
+// file fields answer to their keys too. Caller must hold g_jit_mutex.
+static bool FindJITAttrLocked(uint64_t addr, const std::string &key, std::string &value) {
+  if (key == "name" || key == "file") {
+    auto &table = key == "name" ? g_jit_functions : g_jit_files;
+    auto it = table.find(addr);
+    if (it == table.end()) {
+      return false;
+    }
+    value = it->second;
+    return true;
+  }
+  auto it = g_jit_attrs.find(addr);
+  auto key_id = g_attr_ids.find(key);
+  if (it == g_jit_attrs.end() || key_id == g_attr_ids.end()) {
+    return false;
+  }
+  for (const auto &attr : it->second) {
+    if (attr.first == key_id->second) {
+      value = g_attr_strings[attr.second];
+      return true;
+    }
+  }
+  return false;
+}
+
+// Helper: "key=value" pairs of a registry entry joined by sep.
+// Caller must hold g_jit_mutex.
+static std::string FormatJITAttrsLocked(uint64_t addr, const char *sep) {
+  std::string out;
+  auto it = g_jit_attrs.find(addr);
+  if (it == g_jit_attrs.end()) {
+    return out;
+  }
+  for (const auto &attr : it->second) {
+    if (!out.empty()) {
+      out += sep;
+    }
+    out += g_attr_strings[attr.first] + "=" + g_attr_strings[attr.second];
+  }
+  return out;
+}
+
+// Helper: parse "key=value" (value may be a glob) or a bare "key" that only
+// has to be present.
+static std::pair<std::string, std::string> ParseAttrFilter(const std::string &arg) {
+  size_t eq = arg.find('=');
+  if (eq == std::string::npos) {
+    return std::make_pair(arg, std::string("*"));
+  }
+  return std::make_pair(arg.substr(0, eq), arg.substr(eq + 1));
+}
+
+// Helper: does a registry entry satisfy every attribute filter?
+// Caller must hold g_jit_mutex.
+static bool MatchesAttrFiltersLocked(uint64_t addr, const JITAttrList &filters) {
+  std::string value;
+  for (const auto &filter : filters) {
+    if (!FindJITAttrLocked(addr, filter.first, value) ||
+        fnmatch(filter.second.c_str(), value.c_str(), 0) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Helper: is a registry entry a stub or trampoline? An explicit kind
+// attribute from the VM wins over guessing from the name.
+// Caller must hold g_jit_mutex.
+static bool IsStubEntryLocked(uint64_t addr) {
+  std::string kind;
+  if (FindJITAttrLocked(addr, "kind", kind)) {
+    std::transform(kind.begin(), kind.end(), kind.begin(), ::tolower);
+    return kind.find("stub") != std::string::npos ||
+           kind.find("trampoline") != std::string::npos;
+  }
+  return IsStubName(g_jit_functions[addr]);
+}
+
+// Helper: find the registered function containing pc.
+// Caller must hold g_jit_mutex.
+static bool LookupJITFunctionLocked(uint64_t pc, uint64_t &start) {
+  auto it = g_jit_sizes.upper_bound(pc);
+  if (it == g_jit_sizes.begin()) {
+    return false;
+  }
+  --it;
+  if (pc >= it->first + it->second) {
+    return false;
+  }
+  start = it->first;
+  return true;
+}
+
+// Helper: "function+0xoffset" for an address inside JIT code, else raw hex
+static std::string SymbolizeJITAddress(uint64_t pc) {
+  std::stringstream ss;
+  {
+    std::lock_guard<std::mutex> lock(g_jit_mutex);
+    uint64_t start = 0;
+    if (LookupJITFunctionLocked(pc, start)) {
+      ss << g_jit_functions[start] << "+0x" << std::hex << pc - start;
+      return ss.str();
+    }
+  }
+  ss << "0x" << std::hex << pc;
+  return ss.str();
+}
+
+// What kind of code an address belongs to
+enum JITCodeKind { kCodeNative, kCodeStub, kCodeFunction };
+
+// Helper: classify pc as native code, a VM stub or trampoline, or a compiled
+// Dart function, returning the registered range it falls in.
+static JITCodeKind ClassifyJITAddress(uint64_t pc, uint64_t &start, uint64_t &size) {
+  std::lock_guard<std::mutex> lock(g_jit_mutex);
+  if (!LookupJITFunctionLocked(pc, start)) {
+    return kCodeNative;
+  }
+  size = g_jit_sizes[start];
+  return IsStubEntryLocked(start) ? kCodeStub : kCodeFunction;
+}
+
+static JITCodeKind ClassifyJITAddress(uint64_t pc) {
+  uint64_t start = 0;
+  uint64_t size = 0;
+  return ClassifyJITAddress(pc, start, size);
+}
+
+// Helper: return address of a function stopped at its first instruction.
+// Link-register targets keep it in lr; x86 has it on top of the stack.
+static uint64_t ReturnAddressAtEntry(SBProcess &process, SBFrame &frame) {
+  SBValue lr = frame.FindRegister("lr");
+  if (lr.IsValid()) {
+    return lr.GetValueAsUnsigned();
+  }
+  SBError error;
+  uint64_t ret = process.ReadPointerFromMemory(frame.GetSP(), error);
+  return error.Fail() ? 0 : ret;
+}
+
+// Helper: remember a breakpoint the plugin created, for dart-jit bpcost
+static void RecordOwnedBreakpoint(const SBBreakpoint &bp, const std::string &owner) {
+  std::lock_guard<std::mutex> lock(g_bpcost_mutex);
+  g_owned_bps[bp.GetID()] = owner;
+}
+
+// Helper: forget a deleted plugin breakpoint, folding its cost into its
+// owner's total so short-lived one-shots don't pile up.
+// Caller must hold g_bpcost_mutex.
+static void RetireOwnedBreakpointLocked(break_id_t id) {
+  auto owner = g_owned_bps.find(id);
+  auto cost = g_bp_costs.find(id);
+  if (owner != g_owned_bps.end() && cost != g_bp_costs.end()) {
+    BreakpointCost &retired = g_retired_bp_costs[owner->second];
+    retired.hits += cost->second.hits;
+    retired.auto_continues += cost->second.auto_continues;
+    retired.callback_ns += cost->second.callback_ns;
+  }
+  if (owner != g_owned_bps.end()) {
+    g_owned_bps.erase(owner);
+  }
+  if (cost != g_bp_costs.end()) {
+    g_bp_costs.erase(cost);
+  }
+}
+
+// Helper: make a plugin-internal breakpoint that runs cb and keeps going
+static void SetUpAutoContinueBreakpoint(SBBreakpoint &bp, SBBreakpointHitCallback cb,
+                                        void *baton, const char *name) {
+  bp.SetCallback(cb, baton);
+  bp.SetOneShot(false);
+  bp.SetAutoContinue(true);
+  bp.AddName(name);
+  RecordOwnedBreakpoint(bp, name);
+}
+
+// Helper: microseconds since the plugin was loaded
+static uint64_t SessionMicros(std::chrono::steady_clock::time_point t) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(t - g_session_start).count();
+}
+
+// Helper: escape a string for a JSON string literal
+static std::string JSONEscape(const std::string &str) {
+  std::string out;
+  for (char c : str) {
+    switch (c) {
+    case '"': out += "\\\""; break;
+    case '\\': out += "\\\\"; break;
+    case '\n': out += "\\n"; break;
+    case '\t': out += "\\t"; break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        char buf[8];
+        snprintf(buf, sizeof(buf), "\\u%04x", c);
+        out += buf;
+      } else {
+        out += c;
+      }
+    }
+  }
+  return out;
+}
+
+// Helper: "name (tid)" label for a registering thread
+static std::string ThreadLabel(uint64_t tid, const std::string &name) {
+  std::stringstream ss;
+  ss << (name.empty() ? "<unnamed>" : name) << " (" << tid << ")";
+  std::string label = ss.str();
+  if (label.length() > 30) {
+    label = label.substr(0, 27) + "...";
+  }
+  return label;
+}
+
+// Helper: ThreadLabel for the thread that registered addr, without adding
+// registry entries for unknown addresses or threads.
+// Caller must hold g_jit_mutex.
+static std::string RegisteringThreadLabelLocked(uint64_t addr) {
+  auto tid = g_jit_thread_ids.find(addr);
+  if (tid == g_jit_thread_ids.end()) {
+    return "<added manually>";
+  }
+  auto stats = g_jit_thread_stats.find(tid->second);
+  return ThreadLabel(tid->second, stats != g_jit_thread_stats.end() ? stats->second.name : "");
+}
+
+// Helper: run work(worker, index) for every index in [0, count) on up to
+// max_threads host threads. Workers pull indices from a shared counter.
+static void ParallelFor(size_t count, size_t max_threads,
+                        const std::function<void(size_t, size_t)> &work) {
+  size_t num_threads = std::min(count, std::max<size_t>(1, max_threads));
+  std::atomic<size_t> next(0);
+  auto worker = [&](size_t id) {
+    for (size_t i = next++; i < count; i = next++) {
+      work(id, i);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t id = 1; id < num_threads; ++id) {
+    threads.emplace_back(worker, id);
+  }
+  worker(0);
+  for (auto &t : threads) {
+    t.join();
+  }
+}
+
+// Helper: default worker count for the parallel commands
+static size_t DefaultWorkerCount() {
+  unsigned hw = std::thread::hardware_concurrency();
+  return hw ? hw : 4;
+}
+
+// Helper: map a Dart class id to a name. Predefined class ids come from the
+// dart::ClassId enum in the VM's debug info; anything else is a user class.
+static std::string ClassNameForCid(SBTarget &target, uint32_t cid) {
+  std::lock_guard<std::mutex> lock(g_class_name_mutex);
+  if (!g_class_names_loaded) {
+    g_class_names_loaded = true;
+    SBType class_id = target.FindFirstType("dart::ClassId");
+    if (class_id.IsValid()) {
+      SBTypeEnumMemberList members = class_id.GetEnumMembers();
+      for (uint32_t i = 0; i < members.GetSize(); ++i) {
+        SBTypeEnumMember member = members.GetTypeEnumMemberAtIndex(i);
+        std::string name = member.GetName() ? member.GetName() : "";
+        // kArrayCid -> Array
+        if (name.size() > 4 && name[0] == 'k' &&
+            name.compare(name.size() - 3, 3, "Cid") == 0) {
+          name = name.substr(1, name.size() - 4);
+        }
+        g_class_names.emplace(static_cast<uint32_t>(member.GetValueAsUnsigned()), name);
+      }
+    }
+  }
+  auto it = g_class_names.find(cid);
+  if (it != g_class_names.end()) {
+    return it->second;
+  }
+  return "<class " + std::to_string(cid) + ">";
+}
+
+// Object header layout used to decode Dart heap objects. The defaults match
+// the 64-bit VM's UntaggedObject tags: a 4-bit size tag at bit 8 counted in
+// 16-byte units and a 20-bit class id at bit 12.
+struct DartHeapLayout {
+  uint32_t cid_shift = 12;
+  uint32_t cid_bits = 20;
+  uint32_t size_shift = 8;
+  uint32_t size_bits = 4;
+  uint64_t alignment = 16;
+};
+
+// Helper: class id encoded in an object's header tags
+static uint32_t DecodeClassIdFromTags(uint64_t tags) {
+  DartHeapLayout layout;
+  return static_cast<uint32_t>((tags >> layout.cid_shift) & ((1ULL << layout.cid_bits) - 1));
+}
+
 // Command to list all JIT-compiled functions
 class DartJITListCommand : public SBCommandPluginInterface {
 public:
   bool DoExecute(SBDebugger debugger, char **command,
                  SBCommandReturnObject &result) override {
+    JITAttrList filters;
+    for (char **arg = command; arg && *arg; ++arg) {
+      if (std::string(*arg) == "--attr" && arg[1]) {
+        filters.push_back(ParseAttrFilter(*++arg));
+      } else {
+        result.AppendMessage("Usage: dart-jit list [--attr key[=value-glob]]...");
+        result.SetStatus(eReturnStatusFailed);
+        return false;
+      }
+    }
+
     std::lock_guard<std::mutex> lock(g_jit_mutex);
     
     if (g_jit_functions.empty()) {
@@ -72,6 +664,9 @@ public:
     
     for (const auto& pair : g_jit_functions) {
       uint64_t addr = pair.first;
+      if (!filters.empty() && !MatchesAttrFiltersLocked(addr, filters)) {
+        continue;
+      }
       const std::string& name = pair.second;
       const std::string& file = g_jit_files[addr];
       uint64_t size = g_jit_sizes[addr];
@@ -100,7 +695,13 @@ public:
           display_file = display_file.substr(0, 37) + "...";
         }
       }
-      ss << display_file << "\n";
+      ss << display_file;
+
+      std::string attrs = FormatJITAttrsLocked(addr, ", ");
+      if (!attrs.empty()) {
+        ss << " [" << attrs << "]";
+      }
+      ss << "\n";
     }
     
     result.AppendMessage(ss.str().c_str());
@@ -109,6 +710,124 @@ public:
   }
 };
 
+// Query the registry by payload attributes
+class DartJITQueryCommand : public SBCommandPluginInterface {
+public:
+  bool DoExecute(SBDebugger debugger, char **command,
+                 SBCommandReturnObject &result) override {
+    JITAttrList filters;
+    std::string count_by;
+    bool keys = false;
+    size_t limit = 50;
+    for (char **arg = command; arg && *arg; ++arg) {
+      std::string opt = *arg;
+      if (opt == "--keys") {
+        keys = true;
+      } else if (opt == "--count-by" && arg[1]) {
+        count_by = *++arg;
+      } else if (opt == "--limit" && arg[1]) {
+        limit = strtoull(*++arg, nullptr, 0);
+      } else if (opt.compare(0, 2, "--") != 0) {
+        filters.push_back(ParseAttrFilter(opt));
+      } else {
+        result.AppendMessage(
+            "Usage: dart-jit query [key[=value-glob]...] [--count-by key] [--limit N]\n"
+            "       dart-jit query --keys\n"
+            "Filters registered functions by the extra keys of their debug-info\n"
+            "payload (e.g. tier=optimized kind=stub); name and file match the\n"
+            "built-in fields. --count-by groups the matches by one key's value.");
+        result.SetStatus(eReturnStatusFailed);
+        return false;
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(g_jit_mutex);
+    std::stringstream ss;
+
+    if (keys) {
+      // Per key: how many entries carry it and how many distinct values
+      std::map<std::string, std::pair<uint64_t, std::unordered_set<uint32_t>>> seen;
+      for (const auto &entry : g_jit_attrs) {
+        for (const auto &attr : entry.second) {
+          auto &slot = seen[g_attr_strings[attr.first]];
+          slot.first++;
+          slot.second.insert(attr.second);
+        }
+      }
+      if (seen.empty()) {
+        result.AppendMessage("No payload attributes recorded; the VM only emits the built-in keys.");
+        result.SetStatus(eReturnStatusSuccessFinishResult);
+        return true;
+      }
+      ss << "Key                            Entries  Values\n";
+      ss << "------------------------------ -------- --------\n";
+      for (const auto &pair : seen) {
+        ss << std::left << std::setw(30) << pair.first << std::right << " " << std::setw(8)
+           << pair.second.first << " " << std::setw(8) << pair.second.second.size() << "\n";
+      }
+      ss << g_jit_attrs.size() << " of " << g_jit_functions.size()
+         << " entries carry attributes (" << g_attr_strings.size() << " interned strings).";
+      result.AppendMessage(ss.str().c_str());
+      result.SetStatus(eReturnStatusSuccessFinishResult);
+      return true;
+    }
+
+    std::vector<uint64_t> matches;
+    for (const auto &pair : g_jit_sizes) {
+      if (MatchesAttrFiltersLocked(pair.first, filters)) {
+        matches.push_back(pair.first);
+      }
+    }
+
+    if (!count_by.empty()) {
+      std::map<std::string, std::pair<uint64_t, uint64_t>> groups;
+      for (uint64_t addr : matches) {
+        std::string value = "(none)";
+        FindJITAttrLocked(addr, count_by, value);
+        groups[value].first++;
+        groups[value].second += g_jit_sizes[addr];
+      }
+      std::vector<std::pair<std::string, std::pair<uint64_t, uint64_t>>> rows(groups.begin(),
+                                                                           groups.end());
+      std::sort(rows.begin(), rows.end(), [](const auto &a, const auto &b) {
+        return a.second.first > b.second.first;
+      });
+      ss << "Functions        Bytes  " << count_by << "\n";
+      ss << "--------- ------------  ------------------------------\n";
+      for (const auto &row : rows) {
+        ss << std::setw(9) << row.second.first << " " << std::setw(12) << row.second.second
+           << "  " << row.first << "\n";
+      }
+      ss << matches.size() << " matching function(s).";
+      result.AppendMessage(ss.str().c_str());
+      result.SetStatus(eReturnStatusSuccessFinishResult);
+      return true;
+    }
+
+    ss << "Address            Size     Function Name                  Attributes\n";
+    ss << "------------------ -------- ------------------------------ ---------------------------\n";
+    for (size_t i = 0; i < matches.size() && i < limit; ++i) {
+      uint64_t addr = matches[i];
+      std::string name = g_jit_functions[addr];
+      if (name.length() > 30) {
+        name = name.substr(0, 27) + "...";
+      }
+      char addr_str[32];
+      snprintf(addr_str, sizeof(addr_str), "0x%016" PRIX64, addr);
+      ss << addr_str << " " << std::setw(8) << g_jit_sizes[addr] << " " << std::left
+         << std::setw(30) << name << std::right << " " << FormatJITAttrsLocked(addr, " ") << "\n";
+    }
+    ss << matches.size() << " matching function(s)";
+    if (matches.size() > limit) {
+      ss << ", first " << limit << " shown";
+    }
+    ss << ".";
+    result.AppendMessage(ss.str().c_str());
+    result.SetStatus(eReturnStatusSuccessFinishResult);
+    return true;
+  }
+};
+
 // Set a breakpoint on a JIT-compiled function
 class DartJITBreakCommand : public SBCommandPluginInterface {
 public:
@@ -164,6 +883,7 @@ public:
     
     // We can't set a comment - not supported in this LLDB version
     // Just keep track of it in our internal maps
+    RecordOwnedBreakpoint(bp, "dart-jit break");
     
     std::stringstream ss;
     ss << "Breakpoint set at 0x" << std::hex << func_addr;
@@ -181,7 +901,7 @@ public:
                  SBCommandReturnObject &result) override {
     // This command manually adds a JIT entry for testing
     if (!command || !command[0] || !command[1] || !command[2]) {
-      result.AppendMessage("Usage: dart-jit-add <address> <size> <name> [file]");
+      result.AppendMessage("Usage: dart-jit-add <address> <size> <name> [file] [key=value...]");
       result.SetStatus(eReturnStatusFailed);
       return false;
     }
@@ -190,6 +910,12 @@ public:
     uint64_t size = strtoull(command[1], nullptr, 0);
     std::string name = command[2];
     std::string file = (command[3]) ? command[3] : "unknown";
+    JITAttrList attrs;
+    if (command[3]) {
+      for (char **arg = command + 4; *arg; ++arg) {
+        attrs.push_back(ParseAttrFilter(*arg));
+      }
+    }
     
     if (addr == 0) {
       result.AppendMessage("Invalid address");
@@ -202,6 +928,7 @@ public:
       g_jit_functions[addr] = name;
       g_jit_files[addr] = file;
       g_jit_sizes[addr] = size;
+      SetJITAttrsLocked(addr, attrs);
     }
     
     // Create a symbol in the target for this JIT code
@@ -228,7 +955,8 @@ bool ParseYAMLDebugInfo(const std::string& yaml,
                        uint64_t& addr, 
                        uint64_t& size, 
                        std::string& name, 
-                       std::string& file) {
+                       std::string& file,
+                       JITAttrList* attrs) {
   // Default values
   addr = 0;
   size = 0;
@@ -265,6 +993,12 @@ bool ParseYAMLDebugInfo(const std::string& yaml,
         size = strtoull(value.c_str(), nullptr, 0);
       } else if (key == "file") {
         file = value;
+      } else if (attrs && !key.empty() && !isspace(static_cast<unsigned char>(key[0])) &&
+                 key[0] != '-') {
+        // Keep any other top-level key for the attribute side table
+        size_t end = value.find_last_not_of(" \t\r");
+        value.erase(end == std::string::npos ? 0 : end + 1);
+        attrs->emplace_back(key, value);
       }
     }
   }
@@ -273,49 +1007,553 @@ bool ParseYAMLDebugInfo(const std::string& yaml,
   return (addr != 0 && size != 0);
 }
 
-// Breakpoint callback for monitoring JIT code registrations
-bool BreakpointCallback(void* baton, 
-                       SBProcess& process,
-                       SBThread& thread, 
-                       lldb::SBBreakpointLocation& location) {
-  // This is called when we hit __jit_debug_register_code
-  
-  
-  // Find the __jit_debug_descriptor symbol to get the JIT entry
-  SBTarget target = process.GetTarget();
-  
-  // Use FindSymbols which returns an SBSymbolContextList
-  lldb::SBSymbolContextList symbols = target.FindSymbols("__jit_debug_descriptor", eSymbolTypeData);
-  
-  if (symbols.GetSize() == 0) {
-    std::cerr << "DartJITPlugin: Could not find __jit_debug_descriptor symbol" << std::endl;
-    return false;
+// Helper: claim a sampling slot if interval_us has elapsed since last_us.
+// Only one of several concurrent callers wins.
+static bool ClaimSampleInterval(std::atomic<uint64_t> &last_us, uint64_t interval_us,
+                                uint64_t now_us) {
+  uint64_t last = last_us.load(std::memory_order_relaxed);
+  return now_us - last >= interval_us && last_us.compare_exchange_strong(last, now_us);
+}
+
+// Helper: sample every thread's PC while the process is stopped anyway, if
+// the hot-function or profile sampling interval has elapsed
+static void MaybeSampleThreads(SBProcess &process) {
+  auto started = std::chrono::steady_clock::now();
+  uint64_t now_us = SessionMicros(started);
+  bool hot = ClaimSampleInterval(g_last_sample_us, g_sample_interval_us.load(), now_us);
+  bool recording = g_profile_recording.load(std::memory_order_relaxed) &&
+                   ClaimSampleInterval(g_last_profile_us, g_profile_interval_us.load(), now_us);
+  if (!hot && !recording) {
+    return;
   }
-  
-  lldb::SBSymbolContext context = symbols.GetContextAtIndex(0);
-  SBSymbol descriptor_symbol = context.GetSymbol();
-  
-  if (!descriptor_symbol.IsValid()) {
-    std::cerr << "DartJITPlugin: Could not find __jit_debug_descriptor symbol" << std::endl;
-    return false;
+
+  // Leaf-first frames per thread; whole stacks only while recording a profile
+  struct Frame {
+    uint64_t pc;
+    const char *native_name;
+  };
+  const uint32_t kMaxStackDepth = 64;
+  std::vector<std::vector<Frame>> threads;
+  for (uint32_t i = 0; i < process.GetNumThreads(); ++i) {
+    SBThread thread = process.GetThreadAtIndex(i);
+    uint32_t depth = recording ? std::min(thread.GetNumFrames(), kMaxStackDepth) : 1;
+    threads.emplace_back();
+    for (uint32_t f = 0; f < depth; ++f) {
+      SBFrame frame = thread.GetFrameAtIndex(f);
+      threads.back().push_back(Frame{frame.GetPC(), recording ? frame.GetFunctionName() : nullptr});
+    }
   }
-  
-  SBAddress descriptor_addr = descriptor_symbol.GetStartAddress();
-  SBError error;
-  
-  // Read the descriptor fields
-  uint32_t version = process.ReadUnsignedFromMemory(descriptor_addr.GetLoadAddress(target), 4, error);
-  if (error.Fail()) return false;
-  
-  uint32_t action = process.ReadUnsignedFromMemory(descriptor_addr.GetLoadAddress(target) + 4, 4, error);
-  if (error.Fail()) return false;
-  
-  addr_t relevant_entry_addr = process.ReadPointerFromMemory(descriptor_addr.GetLoadAddress(target) + 8, error);
-  if (error.Fail()) return false;
-  
-  // If there's no entry or action is not register (1), just return
-  if (relevant_entry_addr == 0 || action != 1) {
-    return false;
+
+  std::vector<uint64_t> starts;
+  std::vector<std::string> stacks;
+  {
+    std::lock_guard<std::mutex> lock(g_jit_mutex);
+    for (const auto &frames : threads) {
+      uint64_t start = 0;
+      if (hot && !frames.empty() && LookupJITFunctionLocked(frames[0].pc, start)) {
+        starts.push_back(start);
+      }
+      if (!recording) {
+        continue;
+      }
+      std::string stack;
+      for (auto it = frames.rbegin(); it != frames.rend(); ++it) {
+        std::string name;
+        if (LookupJITFunctionLocked(it->pc, start)) {
+          name = g_jit_functions[start];
+        } else {
+          name = it->native_name ? it->native_name : "[unknown]";
+        }
+        std::replace(name.begin(), name.end(), ';', ',');
+        stack += (stack.empty() ? "" : ";") + name;
+      }
+      stacks.push_back(std::move(stack));
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(g_sample_mutex);
+  for (uint64_t start : starts) {
+    g_hot_samples[start]++;
+  }
+  for (auto &stack : stacks) {
+    g_profile_stacks[stack]++;
+  }
+  if (hot) {
+    g_stat_samples += threads.size();
+  }
+  g_stat_sample_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now() - started).count();
+}
+
+// Counts a plugin callback (a stop of the inferior) and the time spent in
+// it, per cause and per breakpoint. Piggybacked sampling runs before the
+// clock starts and is accounted in g_stat_sample_ns instead.
+struct CallbackCostTimer {
+  CallbackCostTimer(StopCause cause, SBProcess &process, SBBreakpointLocation &location)
+      : cause(cause), breakpoint(location.GetBreakpoint()) {
+    MaybeSampleThreads(process);
+    start = std::chrono::steady_clock::now();
+  }
+
+  ~CallbackCostTimer() {
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now() - start).count();
+    g_stat_stops[cause].fetch_add(1, std::memory_order_relaxed);
+    g_stat_callback_ns[cause].fetch_add(ns, std::memory_order_relaxed);
+
+    bool auto_continue = breakpoint.GetAutoContinue();
+    std::lock_guard<std::mutex> lock(g_bpcost_mutex);
+    BreakpointCost &cost = g_bp_costs[breakpoint.GetID()];
+    cost.hits++;
+    cost.auto_continues += auto_continue;
+    cost.callback_ns += ns;
+    // LLDB deletes a one-shot breakpoint once it has been hit
+    if (breakpoint.IsOneShot()) {
+      RetireOwnedBreakpointLocked(breakpoint.GetID());
+    }
+  }
+
+  StopCause cause;
+  SBBreakpoint breakpoint;
+  std::chrono::steady_clock::time_point start;
+};
+
+// Helper: class allocated by a stub, derived from its name. Generic stubs
+// such as AllocateObject return an empty string: the class comes from the
+// tags register at run time.
+static std::string AllocStubClassName(const std::string &stub_name) {
+  size_t pos = stub_name.find(g_allocprof_pattern);
+  std::string rest = stub_name.substr(pos + g_allocprof_pattern.size());
+  rest.erase(0, rest.find_first_not_of(" _"));
+  if (rest.size() > 4 && rest.compare(rest.size() - 4, 4, "Stub") == 0) {
+    rest.erase(rest.size() - 4);
+  }
+  if (rest.empty() || rest.compare(0, 6, "Object") == 0) {
+    return "";
+  }
+  return rest;
+}
+
+// Breakpoint callback for instrumented allocation stubs
+static bool AllocStubCallback(void *baton, SBProcess &process, SBThread &thread,
+                              SBBreakpointLocation &location) {
+  CallbackCostTimer cost(kStopAlloc, process, location);
+  const AllocStub *stub = static_cast<const AllocStub *>(baton);
+  SBFrame frame = thread.GetFrameAtIndex(0);
+
+  std::string class_name = stub->class_name;
+  if (class_name.empty()) {
+    SBValue tags = frame.FindRegister(g_allocprof_tags_reg.c_str());
+    if (tags.IsValid()) {
+      SBTarget target = process.GetTarget();
+      class_name = ClassNameForCid(target, DecodeClassIdFromTags(tags.GetValueAsUnsigned()));
+    } else {
+      class_name = "<unknown>";
+    }
+  }
+
+  uint64_t call_site = ReturnAddressAtEntry(process, frame);
+
+  std::lock_guard<std::mutex> lock(g_alloc_mutex);
+  g_alloc_counts[std::make_pair(class_name, call_site)]++;
+  return false;  // Continue execution
+}
+
+// Helper: instrument one allocation stub. Caller must hold g_alloc_mutex.
+static bool AttachAllocStubLocked(SBTarget &target, uint64_t addr, const std::string &name) {
+  for (const auto &stub : g_alloc_stubs) {
+    if (stub->addr == addr) {
+      return false;
+    }
+  }
+  SBBreakpoint bp = target.BreakpointCreateByAddress(addr);
+  if (!bp.IsValid()) {
+    return false;
+  }
+  std::unique_ptr<AllocStub> stub(new AllocStub{addr, AllocStubClassName(name), bp.GetID()});
+  SetUpAutoContinueBreakpoint(bp, AllocStubCallback, stub.get(), "__lldb_internal_dart_allocprof");
+  g_alloc_stubs.push_back(std::move(stub));
+  return true;
+}
+
+// Helper: register holding the object tags on entry to the generic
+// allocation stubs (AllocateObjectABI::kTagsReg), or "" if unknown for the
+// target's architecture.
+static std::string AllocTagsRegisterForTarget(SBTarget &target) {
+  const char *triple = target.GetTriple();
+  if (!triple) {
+    return "";
+  }
+  if (strncmp(triple, "x86_64", 6) == 0) {
+    return "r8";
+  }
+  if (strncmp(triple, "aarch64", 7) == 0 || strncmp(triple, "arm64", 5) == 0) {
+    return "x4";
+  }
+  return "";
+}
+
+// Helper: is a registered entry an allocation stub to instrument? The name
+// must match the pattern and the entry must be a stub, so ordinary functions
+// such as _allocateBuffer are left alone. Caller must hold g_jit_mutex.
+static bool IsAllocStubLocked(uint64_t addr, const std::string &name) {
+  return name.find(g_allocprof_pattern) != std::string::npos && IsStubEntryLocked(addr);
+}
+
+// Helper: called for each new registration so stubs compiled after
+// 'allocprof start' are instrumented too
+static void MaybeAttachAllocStub(SBTarget &target, uint64_t addr, const std::string &name) {
+  bool is_alloc_stub = false;
+  {
+    std::lock_guard<std::mutex> lock(g_jit_mutex);
+    is_alloc_stub = IsAllocStubLocked(addr, name);
+  }
+  std::lock_guard<std::mutex> lock(g_alloc_mutex);
+  if (g_allocprof_active && is_alloc_stub) {
+    AttachAllocStubLocked(target, addr, name);
+  }
+}
+
+// Breakpoint callback for the VM's deoptimization entry points. The runtime
+// entry is called from the deopt stub, so walk up to the first registered
+// frame that is not the stub itself: that is the optimized code.
+static bool DeoptCallback(void *baton, SBProcess &process, SBThread &thread,
+                          SBBreakpointLocation &location) {
+  CallbackCostTimer cost(kStopDeopt, process, location);
+  const uint32_t kMaxFrames = 16;
+  uint32_t num_frames = std::min(thread.GetNumFrames(), kMaxFrames);
+  std::string name;
+  uint64_t start = 0;
+  for (uint32_t i = 1; i < num_frames && name.empty(); ++i) {
+    uint64_t pc = thread.GetFrameAtIndex(i).GetPC();
+    std::lock_guard<std::mutex> lock(g_jit_mutex);
+    if (LookupJITFunctionLocked(pc, start) &&
+        g_jit_functions[start].find("Deoptimize") == std::string::npos) {
+      name = g_jit_functions[start];
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(g_deopt_mutex);
+  if (name.empty()) {
+    g_deopt_unattributed++;
+  } else {
+    DeoptStats &stats = g_deopt_stats[name];
+    stats.count++;
+    stats.code_addrs.insert(start);
+  }
+  return false;  // Continue execution
+}
+
+// Breakpoint callback for the return address of a pending GC entry point
+static bool GCExitCallback(void *baton, SBProcess &process, SBThread &thread,
+                           SBBreakpointLocation &location) {
+  CallbackCostTimer cost(kStopGC, process, location);
+  uint64_t now_us = SessionMicros(std::chrono::steady_clock::now());
+  uint64_t tid = thread.GetThreadID();
+  break_id_t id = location.GetBreakpoint().GetID();
+
+  std::lock_guard<std::mutex> lock(g_gc_mutex);
+  auto &pending = g_gc_pending[tid];
+  if (pending.empty() || pending.back().exit_bp_id != id) {
+    return false;
+  }
+  GCPendingPause pause = pending.back();
+  pending.pop_back();
+  uint64_t dur_us = now_us - pause.ts_us;
+  g_gc_pauses_us[pause.kind].push_back(dur_us);
+
+  std::lock_guard<std::mutex> timeline_lock(g_timeline_mutex);
+  g_timeline.push_back(TimelineEvent{"gc", pause.kind, tid, pause.ts_us, dur_us, 0, 0});
+  return false;  // Continue execution
+}
+
+// Breakpoint callback for a GC entry point: note the start time and arm a
+// thread-specific one-shot breakpoint on the return address
+static bool GCEntryCallback(void *baton, SBProcess &process, SBThread &thread,
+                            SBBreakpointLocation &location) {
+  CallbackCostTimer cost(kStopGC, process, location);
+  uint64_t now_us = SessionMicros(std::chrono::steady_clock::now());
+  const std::string *kind = static_cast<const std::string *>(baton);
+  SBFrame frame = thread.GetFrameAtIndex(0);
+  uint64_t return_addr = ReturnAddressAtEntry(process, frame);
+  if (return_addr == 0) {
+    return false;
+  }
+
+  SBTarget target = process.GetTarget();
+  SBBreakpoint exit_bp = target.BreakpointCreateByAddress(return_addr);
+  if (!exit_bp.IsValid()) {
+    return false;
+  }
+  SetUpAutoContinueBreakpoint(exit_bp, GCExitCallback, nullptr, "__lldb_internal_dart_gc");
+  exit_bp.SetOneShot(true);
+  exit_bp.SetThreadID(thread.GetThreadID());
+
+  std::lock_guard<std::mutex> lock(g_gc_mutex);
+  g_gc_pending[thread.GetThreadID()].push_back(GCPendingPause{*kind, now_us, exit_bp.GetID()});
+  return false;  // Continue execution
+}
+
+// Breakpoint callback for a compiler entry point
+static bool CompileStartCallback(void *baton, SBProcess &process, SBThread &thread,
+                                 SBBreakpointLocation &location) {
+  CallbackCostTimer cost(kStopCompile, process, location);
+  auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(g_compile_mutex);
+  auto &starts = g_compile_starts[thread.GetThreadID()];
+  // A compile that bailed out never registers code; don't let those pile up
+  const size_t kMaxNesting = 8;
+  if (starts.size() >= kMaxNesting) {
+    starts.erase(starts.begin());
+  }
+  starts.push_back(now);
+  return false;  // Continue execution
+}
+
+// Helper: close the innermost compile on tid with the registration of addr
+static void RecordCompileTime(uint64_t tid, uint64_t addr,
+                              std::chrono::steady_clock::time_point registered) {
+  std::lock_guard<std::mutex> lock(g_compile_mutex);
+  auto it = g_compile_starts.find(tid);
+  if (it == g_compile_starts.end() || it->second.empty()) {
+    return;
+  }
+  g_compile_us[addr] = std::chrono::duration_cast<std::chrono::microseconds>(
+                           registered - it->second.back()).count();
+  it->second.pop_back();
+}
+
+// Helper: disassemble code loaded at start. Every operand parser in this file
+// expects Intel syntax on x86 (memory operands in [...], destination first),
+// so ask for it explicitly instead of LLDB's default AT&T flavor; other
+// architectures ignore the flavor.
+static SBInstructionList DisassembleJITCode(SBTarget &target, uint64_t start,
+                                            const void *code, size_t size) {
+  return target.GetInstructionsWithFlavor(SBAddress(start, target), "intel", code, size);
+}
+
+// A control transfer inside a code range, as needed to run through it
+struct ControlTransfer {
+  uint64_t addr;
+  uint64_t size;
+  bool is_call;
+  bool is_return;
+  bool has_target;
+  uint64_t dest;
+};
+
+// Helper: decode the calls, branches and returns of code loaded at start
+static std::vector<ControlTransfer> DecodeControlTransfers(SBTarget &target, uint64_t start,
+                                                           const std::vector<uint8_t> &code) {
+  std::vector<ControlTransfer> transfers;
+  const char *triple = target.GetTriple();
+  bool is_arm64 = triple && (strncmp(triple, "aarch64", 7) == 0 || strncmp(triple, "arm64", 5) == 0);
+  SBInstructionList insns = DisassembleJITCode(target, start, code.data(), code.size());
+  for (size_t i = 0; i < insns.GetSize(); ++i) {
+    SBInstruction insn = insns.GetInstructionAtIndex(i);
+    if (!insn.DoesBranch()) {
+      continue;
+    }
+    std::string mnemonic = insn.GetMnemonic(target) ? insn.GetMnemonic(target) : "";
+    ControlTransfer transfer;
+    transfer.addr = insn.GetAddress().GetLoadAddress(target);
+    transfer.size = insn.GetByteSize();
+    transfer.is_call = is_arm64 ? (mnemonic == "bl" || mnemonic == "blr")
+                                : mnemonic.compare(0, 4, "call") == 0;
+    transfer.is_return = mnemonic.compare(0, 3, "ret") == 0;
+    transfer.dest = 0;
+    transfer.has_target = !transfer.is_return &&
+                          ParseDirectBranchTarget(insn.GetOperands(target), transfer.dest);
+    transfers.push_back(transfer);
+  }
+  return transfers;
+}
+
+// Helper: same, reading [start, start + size) from the inferior
+static std::vector<ControlTransfer> DecodeControlTransfers(SBTarget &target, SBProcess &process,
+                                                           uint64_t start, uint64_t size) {
+  std::vector<uint8_t> code(size);
+  SBError error;
+  process.ReadMemory(start, code.data(), code.size(), error);
+  if (error.Fail()) {
+    return std::vector<ControlTransfer>();
+  }
+  return DecodeControlTransfers(target, start, code);
+}
+
+// Cross-reference index of direct calls and jumps between JIT functions.
+// Opt-in: nothing is tracked until dart-jit xrefs first runs. After that,
+// registrations only mark the function dirty; the command decodes dirty code
+// itself before answering, so a replaced function is always re-indexed.
+struct XrefSite {
+  uint64_t from;  // start of the function containing the branch
+  uint64_t site;  // address of the branch
+  uint64_t to;    // branch target
+  bool is_call;
+};
+static std::atomic<bool> g_xref_enabled(false);
+static std::mutex g_xref_mutex;
+static std::unordered_set<uint64_t> g_xref_dirty;  // registered or replaced since last decode
+static std::unordered_map<uint64_t, std::vector<XrefSite>> g_xref_out;  // by caller start
+static std::unordered_map<uint64_t, std::vector<XrefSite>> g_xref_in;   // by callee start
+static std::multimap<uint64_t, XrefSite> g_xref_unresolved;            // by target, not yet registered
+
+// Helper: note new code at addr for the next index refresh
+static void MarkXrefDirty(uint64_t addr) {
+  if (!g_xref_enabled.load(std::memory_order_relaxed)) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(g_xref_mutex);
+  g_xref_dirty.insert(addr);
+}
+
+// Helper: replace the outgoing edges of one function and attach any earlier
+// unresolved branches that land in it. Branches to unregistered code are only
+// parked for later resolution when parkable; parked targets below the
+// registry's lowest start can never resolve and are dropped.
+static void InstallXrefs(uint64_t from, std::vector<XrefSite> &sites,
+                         const std::vector<uint64_t> &callees, const std::vector<bool> &parkable) {
+  uint64_t size = 0;
+  uint64_t code_min = 0;
+  {
+    std::lock_guard<std::mutex> lock(g_jit_mutex);
+    auto it = g_jit_sizes.find(from);
+    if (it != g_jit_sizes.end()) {
+      size = it->second;
+    }
+    if (!g_jit_sizes.empty()) {
+      code_min = g_jit_sizes.begin()->first;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(g_xref_mutex);
+  auto drop = [from](std::vector<XrefSite> &list) {
+    list.erase(std::remove_if(list.begin(), list.end(),
+                              [from](const XrefSite &s) { return s.from == from; }),
+               list.end());
+  };
+  for (const auto &old : g_xref_out[from]) {
+    auto in = g_xref_in.find(old.to);
+    if (in != g_xref_in.end()) {
+      drop(in->second);
+    }
+    auto range = g_xref_unresolved.equal_range(old.to);
+    for (auto it = range.first; it != range.second;) {
+      it = it->second.from == from ? g_xref_unresolved.erase(it) : std::next(it);
+    }
+  }
+
+  for (size_t i = 0; i < sites.size(); ++i) {
+    if (callees[i]) {
+      sites[i].to = callees[i];
+      g_xref_in[callees[i]].push_back(sites[i]);
+    } else if (parkable[i]) {
+      g_xref_unresolved.emplace(sites[i].to, sites[i]);
+    }
+  }
+  g_xref_out[from] = sites;
+  g_xref_unresolved.erase(g_xref_unresolved.begin(), g_xref_unresolved.lower_bound(code_min));
+
+  // Branches decoded before this function was registered
+  auto first = g_xref_unresolved.lower_bound(from);
+  auto last = g_xref_unresolved.lower_bound(from + size);
+  for (auto it = first; it != last; ++it) {
+    XrefSite site = it->second;
+    site.to = from;
+    g_xref_in[from].push_back(site);
+    for (auto &out : g_xref_out[site.from]) {
+      if (out.site == site.site) {
+        out.to = from;
+      }
+    }
+  }
+  g_xref_unresolved.erase(first, last);
+}
+
+// Charges the time the registering thread spends stopped in the callback
+struct RegistrationStopTimer {
+  explicit RegistrationStopTimer(SBThread &thread)
+      : tid(thread.GetThreadID()),
+        name(thread.GetName() ? thread.GetName() : ""),
+        start(std::chrono::steady_clock::now()) {}
+
+  ~RegistrationStopTimer() {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    DART_JIT_PROBE2(register__exit, registered_addr,
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    {
+      std::lock_guard<std::mutex> lock(g_jit_mutex);
+      JITThreadStats &stats = g_jit_thread_stats[tid];
+      stats.name = name;
+      stats.stops++;
+      stats.stop_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    }
+    if (!registered_name.empty()) {
+      std::lock_guard<std::mutex> lock(g_timeline_mutex);
+      g_timeline.push_back(TimelineEvent{
+          "jit", registered_name, tid, SessionMicros(start),
+          static_cast<uint64_t>(
+              std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()),
+          registered_addr, registered_size});
+    }
+  }
+
+  uint64_t tid;
+  std::string name;
+  std::chrono::steady_clock::time_point start;
+
+  // Set once the callback has registered a new function
+  std::string registered_name;
+  uint64_t registered_addr = 0;
+  uint64_t registered_size = 0;
+};
+
+// Breakpoint callback for monitoring JIT code registrations
+bool BreakpointCallback(void* baton, 
+                       SBProcess& process,
+                       SBThread& thread, 
+                       lldb::SBBreakpointLocation& location) {
+  // This is called when we hit __jit_debug_register_code
+  CallbackCostTimer cost(kStopRegister, process, location);
+  RegistrationStopTimer stop_timer(thread);
+  DART_JIT_PROBE1(register__entry, stop_timer.tid);
+  
+  
+  // Find the __jit_debug_descriptor symbol to get the JIT entry
+  SBTarget target = process.GetTarget();
+  
+  // Use FindSymbols which returns an SBSymbolContextList
+  lldb::SBSymbolContextList symbols = target.FindSymbols("__jit_debug_descriptor", eSymbolTypeData);
+  
+  if (symbols.GetSize() == 0) {
+    std::cerr << "DartJITPlugin: Could not find __jit_debug_descriptor symbol" << std::endl;
+    return false;
+  }
+  
+  lldb::SBSymbolContext context = symbols.GetContextAtIndex(0);
+  SBSymbol descriptor_symbol = context.GetSymbol();
+  
+  if (!descriptor_symbol.IsValid()) {
+    std::cerr << "DartJITPlugin: Could not find __jit_debug_descriptor symbol" << std::endl;
+    return false;
+  }
+  
+  SBAddress descriptor_addr = descriptor_symbol.GetStartAddress();
+  SBError error;
+  
+  // Read the descriptor fields
+  uint32_t version = process.ReadUnsignedFromMemory(descriptor_addr.GetLoadAddress(target), 4, error);
+  if (error.Fail()) return false;
+  
+  uint32_t action = process.ReadUnsignedFromMemory(descriptor_addr.GetLoadAddress(target) + 4, 4, error);
+  if (error.Fail()) return false;
+  
+  addr_t relevant_entry_addr = process.ReadPointerFromMemory(descriptor_addr.GetLoadAddress(target) + 8, error);
+  if (error.Fail()) return false;
+  
+  // If there's no entry or action is not register (1), just return
+  if (relevant_entry_addr == 0 || action != 1) {
+    return false;
   }
   
   // Read the JITCodeEntry structure
@@ -342,6 +1580,7 @@ bool BreakpointCallback(void* baton,
   
   std::string yaml(buffer, symfile_size);
   delete[] buffer;
+  DART_JIT_PROBE2(payload__read, symfile_addr, symfile_size);
   
   
   // Parse the YAML data
@@ -349,26 +1588,64 @@ bool BreakpointCallback(void* baton,
   uint64_t code_size = 0;
   std::string func_name;
   std::string source_file;
+  JITAttrList attrs;
   
-  if (!ParseYAMLDebugInfo(yaml, code_addr, code_size, func_name, source_file)) {
+  if (!ParseYAMLDebugInfo(yaml, code_addr, code_size, func_name, source_file, &attrs)) {
     std::cerr << "DartJITPlugin: Failed to parse YAML debug info" << std::endl;
     return false;
   }
+  DART_JIT_PROBE3(parse, code_addr, code_size, func_name.c_str());
   
   // Store the information
+  // A different name at a registered address is new code that reused the
+  // freed range: count it as a new version and run the registration hooks.
   bool already_registered = false;
+  bool name_changed = false;
+  bool code_replaced = false;
   {
     std::lock_guard<std::mutex> lock(g_jit_mutex);
-    already_registered = g_jit_functions.count(code_addr) > 0;
+    auto existing = g_jit_functions.find(code_addr);
+    already_registered = existing != g_jit_functions.end();
+    name_changed = already_registered && existing->second != func_name;
+    code_replaced = name_changed || (already_registered && g_jit_sizes[code_addr] != code_size);
     g_jit_functions[code_addr] = func_name;
     g_jit_files[code_addr] = source_file;
     g_jit_sizes[code_addr] = code_size;
+    g_jit_thread_ids[code_addr] = stop_timer.tid;
+    SetJITAttrsLocked(code_addr, attrs);
+    if (!already_registered || name_changed) {
+      g_jit_name_versions[func_name]++;
+      JITThreadStats &stats = g_jit_thread_stats[stop_timer.tid];
+      stats.registrations++;
+      stats.bytes += code_size;
+      g_stat_registrations.fetch_add(1, std::memory_order_relaxed);
+      g_stat_code_bytes.fetch_add(code_size, std::memory_order_relaxed);
+    }
+    if (!already_registered) {
+      // Rough registry footprint: strings plus the map nodes holding them
+      const uint64_t kEntryOverhead = 6 * 48;
+      g_stat_registry_bytes.fetch_add(func_name.capacity() + source_file.capacity() + kEntryOverhead +
+                                          attrs.size() * sizeof(JITAttrs::value_type),
+                                      std::memory_order_relaxed);
+    }
   }
   
+  DART_JIT_PROBE2(index__insert, code_addr, already_registered);
+
+  if (!already_registered || code_replaced) {
+    MarkXrefDirty(code_addr);
+  }
+
   // Skip duplicate registrations
-  if (already_registered) {
+  if (already_registered && !name_changed) {
     return false;
   }
+
+  RecordCompileTime(stop_timer.tid, code_addr, stop_timer.start);
+
+  stop_timer.registered_name = func_name;
+  stop_timer.registered_addr = code_addr;
+  stop_timer.registered_size = code_size;
   
   std::cout << "Registered symbol for function " << func_name 
             << " at 0x" << std::hex << code_addr 
@@ -379,60 +1656,23 @@ bool BreakpointCallback(void* baton,
             << " (size: " << std::dec << code_size << " bytes, file: " << source_file << ")" 
             << std::endl;
 
+  MaybeAttachAllocStub(target, code_addr, func_name);
+
   if (MatchesPending(func_name) && !g_active_bp_addrs.count(code_addr)) {
-      // Get the debugger from the target
-      SBDebugger debugger = target.GetDebugger();
-      SBCommandInterpreter interpreter = debugger.GetCommandInterpreter();
-      SBCommandReturnObject cmd_result;
-      
-      // Try using LLDB command to set the breakpoint
-      std::stringstream cmd;
-      cmd << "breakpoint set --address 0x" << std::hex << code_addr;
-      
-      interpreter.HandleCommand(cmd.str().c_str(), cmd_result);
-      
-      if (cmd_result.Succeeded()) {
+      DART_JIT_PROBE2(watch__match, code_addr, func_name.c_str());
+
+      SBBreakpoint bp = target.BreakpointCreateByAddress(code_addr);
+      DART_JIT_PROBE2(bp__create, code_addr, bp.IsValid());
+
+      if (bp.IsValid()) {
           g_active_bp_addrs.insert(code_addr);
+          RecordOwnedBreakpoint(bp, "dart-jit watch");
       }
   }
 
   return false; // Continue execution
 }
 
-// Main multiword command for Dart JIT debugging
-class DartJITCommand : public SBCommandPluginInterface {
-public:
-  bool DoExecute(SBDebugger debugger, char **command,
-                 SBCommandReturnObject &result) override {
-    if (!command || !command[0]) {
-      result.AppendMessage("Dart JIT debugger plugin commands:\n"
-                          "  dart-jit list   - List all JIT-compiled functions\n"
-                          "  dart-jit break  - Set a breakpoint in a JIT-compiled function\n"
-                          "  dart-jit add    - Manually add a JIT function (for testing)\n"
-                          "  dart-jit watch  - Add breakpoint to a func_name in advance\n");
-      result.SetStatus(eReturnStatusSuccessFinishNoResult);
-      return true;
-    }
-    
-    std::string subcommand = command[0];
-    
-    if (subcommand == "list") {
-      DartJITListCommand list_cmd;
-      return list_cmd.DoExecute(debugger, command + 1, result);
-    } else if (subcommand == "break") {
-      DartJITBreakCommand break_cmd;
-      return break_cmd.DoExecute(debugger, command + 1, result);
-    } else if (subcommand == "add") {
-      DartJITAddCommand add_cmd;
-      return add_cmd.DoExecute(debugger, command + 1, result);
-    } else {
-      result.AppendMessage("Unknown subcommand. Use 'dart-jit' for help.");
-      result.SetStatus(eReturnStatusFailed);
-      return false;
-    }
-  }
-};
-
 // Set up JIT debugging in the target
 class DartJITSetupCommand : public SBCommandPluginInterface {
 public:
@@ -460,6 +1700,7 @@ public:
     bp.SetOneShot(false);
     bp.SetAutoContinue(true);
     bp.AddName("__lldb_internal_jit_monitor");
+    RecordOwnedBreakpoint(bp, "__lldb_internal_jit_monitor");
     
     // Try to make it truly internal (might not be supported in all LLDB versions)
     // bp.SetInternal(true);  // This method might not exist
@@ -482,21 +1723,32 @@ public:
                  SBCommandReturnObject &res) override {
 
     // No arguments?  Print usage.
-    if (!cmd || !cmd[0]) {
+    if (!cmd || !cmd[0] || (std::string(cmd[0]) == "--from-file" && !cmd[1])) {
       res.AppendMessage(
           "Usage: dart-jit watch <pattern> [more patterns…]\n"
+          "       dart-jit watch --from-file <path>\n"
           "Adds substring pattern(s) to the list of names that will\n"
           "automatically receive a breakpoint the first time the JIT\n"
-          "registers them.");
+          "registers them.\n"
+          "A watch file holds one name per line ('#' starts a comment).\n"
+          "Plain lines are exact function names; lines containing *, ? or [\n"
+          "are glob patterns.");
       res.SetStatus(eReturnStatusFailed);
       return false;
     }
 
+    if (std::string(cmd[0]) == "--from-file") {
+      return LoadFile(cmd[1], res);
+    }
+
     // Push every argument into the global vector
     size_t added = 0;
+    std::lock_guard<std::mutex> lock(g_pending_mutex);
     while (*cmd) {
       std::string pat = *cmd++;
       if (!pat.empty()) {
+        // Convert pattern to lowercase for case-insensitive matching
+        std::transform(pat.begin(), pat.end(), pat.begin(), ::tolower);
         g_pending_patterns.push_back(pat);
         ++added;
       }
@@ -510,26 +1762,4305 @@ public:
     res.SetStatus(eReturnStatusSuccessFinishResult);
     return true;
   }
+
+private:
+  bool LoadFile(const char *path, SBCommandReturnObject &res) {
+    std::ifstream in(path);
+    if (!in) {
+      std::string msg = std::string("Cannot open watch file: ") + path;
+      res.AppendMessage(msg.c_str());
+      res.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    size_t exact = 0;
+    size_t globs = 0;
+    std::string line;
+    std::lock_guard<std::mutex> lock(g_pending_mutex);
+    while (std::getline(in, line)) {
+      // Trim whitespace (including a trailing \r from CRLF files)
+      size_t start = line.find_first_not_of(" \t\r");
+      if (start == std::string::npos || line[start] == '#') {
+        continue;
+      }
+      line = line.substr(start, line.find_last_not_of(" \t\r") - start + 1);
+
+      if (line.find_first_of("*?[") != std::string::npos) {
+        g_pending_globs.push_back(line);
+        ++globs;
+      } else if (g_pending_exact.insert(line).second) {
+        ++exact;
+      }
+    }
+
+    std::ostringstream msg;
+    msg << "Loaded " << exact << " exact name" << (exact == 1 ? "" : "s")
+        << " and " << globs << " glob pattern" << (globs == 1 ? "" : "s")
+        << " from " << path << " into the pending-breakpoint watch list.";
+    res.AppendMessage(msg.str().c_str());
+    res.SetStatus(eReturnStatusSuccessFinishResult);
+    return true;
+  }
 };
 
-// Plugin initialization function
-namespace lldb {
-bool PluginInitialize(SBDebugger debugger) {
-  SBCommandInterpreter interpreter = debugger.GetCommandInterpreter();
-  
-  // Add the dart-jit multiword command
-  SBCommand dartjit = interpreter.AddMultiwordCommand(
-      "dart-jit", "Dart JIT debugging commands");
-  
-  if (dartjit.IsValid()) {
-    dartjit.AddCommand("list", new DartJITListCommand(),
-                      "List all JIT-compiled Dart functions", nullptr);
-    dartjit.AddCommand("break", new DartJITBreakCommand(),
-                      "Set a breakpoint in a JIT-compiled Dart function", nullptr);
-    dartjit.AddCommand("add", new DartJITAddCommand(),
-                      "Manually add a JIT function (for testing)", nullptr);
-    dartjit.AddCommand("watch", new DartJITWatchCommand(),
-                       "Add pattern(s) for automatic breakpoints", nullptr);
+// Annotate a JIT-compiled function's disassembly with profile sample counts
+class DartJITAnnotateCommand : public SBCommandPluginInterface {
+public:
+  bool DoExecute(SBDebugger debugger, char **command,
+                 SBCommandReturnObject &result) override {
+    if (!command || !command[0] || !command[1]) {
+      result.AppendMessage(
+          "Usage: dart-jit annotate <function-name> <samples-file>\n"
+          "The samples file holds one PC per line (hex), optionally followed\n"
+          "by a count, e.g. sampled IPs or instruction-trace counts.");
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    SBTarget target = debugger.GetSelectedTarget();
+    SBProcess process = target.GetProcess();
+    if (!target.IsValid() || !process.IsValid()) {
+      result.AppendMessage("No valid process. Please run the program first.");
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    uint64_t func_addr = 0;
+    uint64_t func_size = 0;
+    std::string func_name;
+    if (!FindJITFunctionByName(command[0], func_addr, func_size, func_name) ||
+        func_size == 0) {
+      std::stringstream ss;
+      ss << "Function '" << command[0] << "' not found in JIT-compiled code. ";
+      ss << "Use 'dart-jit list' to see available functions.";
+      result.AppendMessage(ss.str().c_str());
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    std::ifstream in(command[1]);
+    if (!in) {
+      std::string msg = std::string("Cannot open samples file: ") + command[1];
+      result.AppendMessage(msg.c_str());
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    // Bucket the samples by PC offset so every lookup below is O(1)
+    std::vector<uint64_t> buckets(func_size, 0);
+    uint64_t total = 0;
+    uint64_t outside = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+      const char *p = line.c_str();
+      while (isspace(static_cast<unsigned char>(*p))) {
+        ++p;
+      }
+      if (*p == '\0' || *p == '#') {
+        continue;
+      }
+      char *end = nullptr;
+      uint64_t pc = strtoull(p, &end, 16);
+      uint64_t count = strtoull(end, nullptr, 10);
+      if (count == 0) {
+        count = 1;
+      }
+      if (pc >= func_addr && pc < func_addr + func_size) {
+        buckets[pc - func_addr] += count;
+        total += count;
+      } else {
+        outside += count;
+      }
+    }
+
+    if (total == 0) {
+      std::stringstream ss;
+      ss << "No samples fall inside '" << func_name << "' (" << outside
+         << " samples outside its range).";
+      result.AppendMessage(ss.str().c_str());
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    std::vector<uint8_t> code(func_size);
+    SBError error;
+    process.ReadMemory(func_addr, code.data(), code.size(), error);
+    if (error.Fail()) {
+      result.AppendMessage("Failed to read the function's code from memory.");
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    SBInstructionList insns = DisassembleJITCode(target, func_addr, code.data(), code.size());
+    size_t num_insns = insns.GetSize();
+    if (num_insns == 0) {
+      result.AppendMessage("Failed to disassemble the function.");
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    // Per-instruction counts, plus basic block leaders: the entry, every
+    // in-range branch target and every instruction following a branch.
+    std::vector<uint64_t> offsets(num_insns);
+    std::vector<uint64_t> counts(num_insns, 0);
+    std::vector<bool> leader(num_insns, false);
+    std::unordered_set<uint64_t> targets;
+    bool prev_branch = true;
+    for (size_t i = 0; i < num_insns; ++i) {
+      SBInstruction insn = insns.GetInstructionAtIndex(i);
+      uint64_t offset = insn.GetAddress().GetLoadAddress(target) - func_addr;
+      uint64_t end = std::min<uint64_t>(offset + insn.GetByteSize(), func_size);
+      offsets[i] = offset;
+      for (uint64_t o = offset; o < end; ++o) {
+        counts[i] += buckets[o];
+      }
+      leader[i] = prev_branch;
+      prev_branch = insn.DoesBranch();
+      uint64_t branch_target = 0;
+      if (prev_branch && ParseDirectBranchTarget(insn.GetOperands(target), branch_target) &&
+          branch_target >= func_addr && branch_target < func_addr + func_size) {
+        targets.insert(branch_target - func_addr);
+      }
+    }
+
+    std::vector<size_t> block_start;
+    std::vector<uint64_t> block_count;
+    std::vector<size_t> block_of(num_insns);
+    for (size_t i = 0; i < num_insns; ++i) {
+      if (leader[i] || targets.count(offsets[i])) {
+        block_start.push_back(i);
+        block_count.push_back(0);
+      }
+      block_of[i] = block_start.size() - 1;
+      block_count.back() += counts[i];
+    }
+
+    // Rank the blocks so the hottest ones can be flagged inline
+    std::vector<size_t> ranked(block_start.size());
+    for (size_t b = 0; b < ranked.size(); ++b) {
+      ranked[b] = b;
+    }
+    std::sort(ranked.begin(), ranked.end(), [&](size_t a, size_t b) {
+      return block_count[a] > block_count[b];
+    });
+    std::vector<int> hot_rank(block_start.size(), 0);
+    const size_t kHotBlocks = 3;
+    for (size_t r = 0; r < ranked.size() && r < kHotBlocks; ++r) {
+      if (block_count[ranked[r]] > 0) {
+        hot_rank[ranked[r]] = static_cast<int>(r + 1);
+      }
+    }
+
+    std::stringstream ss;
+    ss << "Annotation of '" << func_name << "' at 0x" << std::hex << func_addr
+       << std::dec << " (size: " << func_size << " bytes, samples: " << total
+       << ", outside: " << outside << ")\n";
+    ss << " Percent | Offset  Instruction\n";
+    ss << "---------+------------------------------------------------------------\n";
+    ss << std::fixed << std::setprecision(2);
+    for (size_t i = 0; i < num_insns; ++i) {
+      size_t b = block_of[i];
+      if (block_start[b] == i) {
+        ss << "         | block " << b << ": "
+           << 100.0 * block_count[b] / total << "%";
+        if (hot_rank[b]) {
+          ss << "  <== hot #" << hot_rank[b];
+        }
+        ss << "\n";
+      }
+      SBInstruction insn = insns.GetInstructionAtIndex(i);
+      if (counts[i]) {
+        ss << std::setw(8) << 100.0 * counts[i] / total;
+      } else {
+        ss << std::setw(8) << "";
+      }
+      ss << " | " << (hot_rank[b] ? '*' : ' ') << "+" << std::left << std::setw(6)
+         << offsets[i] << std::right << insn.GetMnemonic(target) << " "
+         << insn.GetOperands(target) << "\n";
+    }
+
+    ss << "\nHottest blocks:\n";
+    for (size_t r = 0; r < ranked.size() && r < kHotBlocks; ++r) {
+      size_t b = ranked[r];
+      if (block_count[b] == 0) {
+        break;
+      }
+      size_t last = (b + 1 < block_start.size()) ? block_start[b + 1] - 1 : num_insns - 1;
+      ss << "  #" << r + 1 << " block " << b << " [+" << offsets[block_start[b]]
+         << ", +" << offsets[last] << "] " << 100.0 * block_count[b] / total
+         << "% (" << block_count[b] << " samples)\n";
+    }
+
+    result.AppendMessage(ss.str().c_str());
+    result.SetStatus(eReturnStatusSuccessFinishResult);
+    return true;
+  }
+};
+
+// Deoptimization tracker joined with the number of code versions per function
+class DartJITDeoptsCommand : public SBCommandPluginInterface {
+public:
+  bool DoExecute(SBDebugger debugger, char **command,
+                 SBCommandReturnObject &result) override {
+    std::string action = (command && command[0]) ? command[0] : "report";
+    SBTarget target = debugger.GetSelectedTarget();
+
+    if (action == "enable") {
+      if (!target.IsValid()) {
+        result.AppendMessage("No valid target selected. Please select a target first.");
+        result.SetStatus(eReturnStatusFailed);
+        return false;
+      }
+      std::vector<std::string> symbols;
+      for (char **arg = command + 1; *arg; ++arg) {
+        symbols.push_back(*arg);
+      }
+      // The VM defines DeoptimizeCopyFrame as a leaf runtime entry, which is
+      // emitted as extern "C" DLRT_DeoptimizeCopyFrame in every build mode.
+      // The C++ name is only tried if that symbol is missing.
+      bool use_default = symbols.empty();
+      if (use_default) {
+        symbols.push_back("DLRT_DeoptimizeCopyFrame");
+        symbols.push_back("dart::DeoptimizeCopyFrame");
+      }
+
+      std::lock_guard<std::mutex> lock(g_deopt_mutex);
+      if (!g_deopt_bp_ids.empty()) {
+        result.AppendMessage("Deoptimization tracking is already enabled.");
+        result.SetStatus(eReturnStatusFailed);
+        return false;
+      }
+      std::stringstream ss;
+      for (const auto &symbol : symbols) {
+        if (use_default && !g_deopt_bp_ids.empty()) {
+          break;
+        }
+        SBBreakpoint bp = target.BreakpointCreateByName(symbol.c_str());
+        if (!bp.IsValid() || bp.GetNumLocations() == 0) {
+          ss << "Warning: no locations for '" << symbol
+             << "' (is the VM binary loaded with its symbols?).\n";
+          if (bp.IsValid()) {
+            target.BreakpointDelete(bp.GetID());
+          }
+          continue;
+        }
+        SetUpAutoContinueBreakpoint(bp, DeoptCallback, nullptr, "__lldb_internal_dart_deopt");
+        g_deopt_bp_ids.push_back(bp.GetID());
+        ss << "Tracking deoptimizations at '" << symbol << "'.\n";
+      }
+      result.AppendMessage(ss.str().c_str());
+      result.SetStatus(g_deopt_bp_ids.empty() ? eReturnStatusFailed
+                                              : eReturnStatusSuccessFinishResult);
+      return !g_deopt_bp_ids.empty();
+    }
+
+    if (action == "disable") {
+      std::lock_guard<std::mutex> lock(g_deopt_mutex);
+      for (break_id_t id : g_deopt_bp_ids) {
+        if (target.IsValid()) {
+          target.BreakpointDelete(id);
+        }
+      }
+      g_deopt_bp_ids.clear();
+      result.AppendMessage("Deoptimization tracking disabled.");
+      result.SetStatus(eReturnStatusSuccessFinishResult);
+      return true;
+    }
+
+    if (action == "clear") {
+      std::lock_guard<std::mutex> lock(g_deopt_mutex);
+      g_deopt_stats.clear();
+      g_deopt_unattributed = 0;
+      result.AppendMessage("Deoptimization counts cleared.");
+      result.SetStatus(eReturnStatusSuccessFinishResult);
+      return true;
+    }
+
+    if (action != "report" && !isdigit(static_cast<unsigned char>(action[0]))) {
+      result.AppendMessage(
+          "Usage: dart-jit deopts enable [symbol...]\n"
+          "       dart-jit deopts [report] [N]\n"
+          "       dart-jit deopts disable | clear\n"
+          "Counts deoptimizations per optimized JIT function with auto-continuing\n"
+          "breakpoints on the VM's deopt entry points (default: the leaf\n"
+          "runtime entry DLRT_DeoptimizeCopyFrame, falling back to\n"
+          "dart::DeoptimizeCopyFrame).");
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    const char *count_arg = (action == "report") ? command[1] : command[0];
+    size_t top = count_arg ? strtoull(count_arg, nullptr, 0) : 20;
+
+    struct Row {
+      std::string name;
+      uint64_t deopts;
+      size_t addrs;
+      uint32_t versions;
+    };
+    std::vector<Row> rows;
+    uint64_t unattributed = 0;
+    {
+      std::lock_guard<std::mutex> lock(g_deopt_mutex);
+      for (const auto &pair : g_deopt_stats) {
+        rows.push_back(Row{pair.first, pair.second.count, pair.second.code_addrs.size(), 0});
+      }
+      unattributed = g_deopt_unattributed;
+    }
+    {
+      std::lock_guard<std::mutex> lock(g_jit_mutex);
+      for (auto &row : rows) {
+        auto it = g_jit_name_versions.find(row.name);
+        row.versions = (it != g_jit_name_versions.end()) ? it->second : 0;
+      }
+    }
+    std::sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) {
+      return a.deopts != b.deopts ? a.deopts > b.deopts : a.versions > b.versions;
+    });
+
+    if (rows.empty() && unattributed == 0) {
+      result.AppendMessage("No deoptimizations recorded. Use 'dart-jit deopts enable' first.");
+      result.SetStatus(eReturnStatusSuccessFinishResult);
+      return true;
+    }
+
+    std::stringstream ss;
+    ss << "Deoptimizations by function:\n";
+    ss << "----------------------------\n";
+    ss << "Deopts   Versions Deopted  Function Name\n";
+    ss << "-------- -------- -------- ------------------------------\n";
+    for (size_t i = 0; i < rows.size() && i < top; ++i) {
+      ss << std::left << std::setw(8) << rows[i].deopts << " "
+         << std::setw(8) << rows[i].versions << " "
+         << std::setw(8) << rows[i].addrs << " " << rows[i].name << "\n";
+    }
+    ss << "\nVersions: times the name was registered; Deopted: distinct code\n"
+       << "versions that deoptimized.";
+    if (unattributed) {
+      ss << "\n" << unattributed << " deoptimization(s) could not be attributed "
+         << "to a registered function.";
+    }
+    result.AppendMessage(ss.str().c_str());
+    result.SetStatus(eReturnStatusSuccessFinishResult);
+    return true;
+  }
+};
+
+// GC pause tracking with a duration histogram
+class DartJITGCCommand : public SBCommandPluginInterface {
+public:
+  bool DoExecute(SBDebugger debugger, char **command,
+                 SBCommandReturnObject &result) override {
+    std::string action = (command && command[0]) ? command[0] : "report";
+    SBTarget target = debugger.GetSelectedTarget();
+
+    if (action == "enable") {
+      if (!target.IsValid()) {
+        result.AppendMessage("No valid target selected. Please select a target first.");
+        result.SetStatus(eReturnStatusFailed);
+        return false;
+      }
+      std::vector<std::string> symbols;
+      for (char **arg = command + 1; *arg; ++arg) {
+        symbols.push_back(*arg);
+      }
+      if (symbols.empty()) {
+        symbols.push_back("dart::Heap::CollectNewSpaceGarbage");
+        symbols.push_back("dart::Heap::CollectOldSpaceGarbage");
+      }
+
+      std::lock_guard<std::mutex> lock(g_gc_mutex);
+      if (!g_gc_bp_ids.empty()) {
+        result.AppendMessage("GC pause tracking is already enabled.");
+        result.SetStatus(eReturnStatusFailed);
+        return false;
+      }
+      std::stringstream ss;
+      for (const auto &symbol : symbols) {
+        SBBreakpoint bp = target.BreakpointCreateByName(symbol.c_str());
+        if (!bp.IsValid() || bp.GetNumLocations() == 0) {
+          ss << "Warning: no locations for '" << symbol << "'.\n";
+          if (bp.IsValid()) {
+            target.BreakpointDelete(bp.GetID());
+          }
+          continue;
+        }
+        // Label pauses by the collector: Heap::CollectNewSpaceGarbage -> NewSpace
+        std::string kind = symbol.substr(symbol.rfind(':') + 1);
+        if (kind.compare(0, 7, "Collect") == 0 && kind.size() > 14 &&
+            kind.compare(kind.size() - 7, 7, "Garbage") == 0) {
+          kind = kind.substr(7, kind.size() - 14);
+        }
+        g_gc_kinds.emplace_back(new std::string(kind));
+        SetUpAutoContinueBreakpoint(bp, GCEntryCallback, g_gc_kinds.back().get(),
+                                    "__lldb_internal_dart_gc");
+        g_gc_bp_ids.push_back(bp.GetID());
+        ss << "Tracking " << kind << " pauses at '" << symbol << "'.\n";
+      }
+      result.AppendMessage(ss.str().c_str());
+      result.SetStatus(g_gc_bp_ids.empty() ? eReturnStatusFailed
+                                           : eReturnStatusSuccessFinishResult);
+      return !g_gc_bp_ids.empty();
+    }
+
+    if (action == "disable") {
+      std::lock_guard<std::mutex> lock(g_gc_mutex);
+      for (break_id_t id : g_gc_bp_ids) {
+        if (target.IsValid()) {
+          target.BreakpointDelete(id);
+        }
+      }
+      g_gc_bp_ids.clear();
+      // Pauses still in flight would never see their exit breakpoints
+      size_t pending_exits = 0;
+      {
+        std::lock_guard<std::mutex> cost_lock(g_bpcost_mutex);
+        for (const auto &pair : g_gc_pending) {
+          for (const auto &pause : pair.second) {
+            if (target.IsValid()) {
+              target.BreakpointDelete(pause.exit_bp_id);
+            }
+            RetireOwnedBreakpointLocked(pause.exit_bp_id);
+            ++pending_exits;
+          }
+        }
+      }
+      g_gc_pending.clear();
+      std::stringstream ss;
+      ss << "GC pause tracking disabled";
+      if (pending_exits) {
+        ss << ", dropped " << pending_exits << " unfinished pause(s)";
+      }
+      ss << ".";
+      result.AppendMessage(ss.str().c_str());
+      result.SetStatus(eReturnStatusSuccessFinishResult);
+      return true;
+    }
+
+    if (action == "clear") {
+      std::lock_guard<std::mutex> lock(g_gc_mutex);
+      g_gc_pauses_us.clear();
+      result.AppendMessage("GC pause statistics cleared.");
+      result.SetStatus(eReturnStatusSuccessFinishResult);
+      return true;
+    }
+
+    if (action != "report") {
+      result.AppendMessage(
+          "Usage: dart-jit gc enable [entry-symbol...]\n"
+          "       dart-jit gc [report] | disable | clear\n"
+          "Brackets the VM's collector entry points (default:\n"
+          "dart::Heap::CollectNewSpaceGarbage and CollectOldSpaceGarbage) with\n"
+          "auto-continuing breakpoints and records each pause. Durations are\n"
+          "host wall-clock time and include the two breakpoint round trips.\n"
+          "Use 'dart-jit timeline export' to merge them with JIT activity.");
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    std::map<std::string, std::vector<uint64_t>> pauses;
+    {
+      std::lock_guard<std::mutex> lock(g_gc_mutex);
+      pauses = g_gc_pauses_us;
+    }
+    if (pauses.empty()) {
+      result.AppendMessage("No GC pauses recorded. Use 'dart-jit gc enable' first.");
+      result.SetStatus(eReturnStatusSuccessFinishResult);
+      return true;
+    }
+
+    // Power-of-two histogram buckets from <128us up to >=128ms
+    const size_t kBuckets = 12;
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(2);
+    for (auto &pair : pauses) {
+      std::vector<uint64_t> &durations = pair.second;
+      std::sort(durations.begin(), durations.end());
+      uint64_t total = 0;
+      std::vector<uint64_t> histogram(kBuckets, 0);
+      for (uint64_t d : durations) {
+        total += d;
+        size_t bucket = 0;
+        while (bucket + 1 < kBuckets && d >= (128ULL << bucket)) {
+          ++bucket;
+        }
+        histogram[bucket]++;
+      }
+      size_t n = durations.size();
+      ss << pair.first << ": " << n << " pauses, total " << total / 1e3 << " ms, p50 "
+         << durations[n / 2] / 1e3 << " ms, p99 " << durations[(n * 99) / 100] / 1e3
+         << " ms, max " << durations.back() / 1e3 << " ms\n";
+      uint64_t peak = *std::max_element(histogram.begin(), histogram.end());
+      for (size_t b = 0; b < kBuckets; ++b) {
+        if (histogram[b] == 0) {
+          continue;
+        }
+        std::stringstream label;
+        label << (b + 1 < kBuckets ? "< " : ">= ")
+              << (128ULL << (b + 1 < kBuckets ? b : b - 1)) << "us";
+        ss << "  " << std::left << std::setw(12) << label.str() << std::right
+           << std::setw(8) << histogram[b] << " "
+           << std::string(1 + 40 * histogram[b] / peak, '#') << "\n";
+      }
+    }
+    result.AppendMessage(ss.str().c_str());
+    result.SetStatus(eReturnStatusSuccessFinishResult);
+    return true;
+  }
+};
+
+// Export the registration and GC timeline in Chrome trace event format
+class DartJITTimelineCommand : public SBCommandPluginInterface {
+public:
+  bool DoExecute(SBDebugger debugger, char **command,
+                 SBCommandReturnObject &result) override {
+    if (!command || !command[0] || std::string(command[0]) != "export" || !command[1]) {
+      result.AppendMessage(
+          "Usage: dart-jit timeline export <file.json>\n"
+          "Writes JIT registrations and recorded GC pauses as Chrome trace\n"
+          "events (open in chrome://tracing or Perfetto).");
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    std::vector<TimelineEvent> events;
+    {
+      std::lock_guard<std::mutex> lock(g_timeline_mutex);
+      events = g_timeline;
+    }
+    std::sort(events.begin(), events.end(), [](const TimelineEvent &a, const TimelineEvent &b) {
+      return a.ts_us < b.ts_us;
+    });
+
+    // Attach each function's payload attributes to its event
+    std::vector<JITAttrList> event_attrs(events.size());
+    {
+      std::lock_guard<std::mutex> lock(g_jit_mutex);
+      for (size_t i = 0; i < events.size(); ++i) {
+        auto it = g_jit_attrs.find(events[i].addr);
+        if (events[i].category != "jit" || it == g_jit_attrs.end()) {
+          continue;
+        }
+        for (const auto &attr : it->second) {
+          event_attrs[i].emplace_back(g_attr_strings[attr.first], g_attr_strings[attr.second]);
+        }
+      }
+    }
+
+    std::ofstream out(command[1]);
+    if (!out) {
+      std::string msg = std::string("Cannot write ") + command[1];
+      result.AppendMessage(msg.c_str());
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+    out << "{\"traceEvents\":[\n";
+    for (size_t i = 0; i < events.size(); ++i) {
+      const TimelineEvent &e = events[i];
+      out << "{\"name\":\"" << JSONEscape(e.name) << "\",\"cat\":\"" << e.category
+          << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.tid << ",\"ts\":" << e.ts_us
+          << ",\"dur\":" << e.dur_us;
+      if (e.category == "jit") {
+        out << ",\"args\":{\"addr\":\"0x" << std::hex << e.addr << std::dec
+            << "\",\"size\":" << e.size;
+        for (const auto &attr : event_attrs[i]) {
+          out << ",\"" << JSONEscape(attr.first) << "\":\"" << JSONEscape(attr.second) << "\"";
+        }
+        out << "}";
+      }
+      out << "}" << (i + 1 < events.size() ? "," : "") << "\n";
+    }
+    out << "],\"displayTimeUnit\":\"ms\"}\n";
+
+    std::stringstream ss;
+    ss << "Wrote " << events.size() << " timeline event(s) to " << command[1] << ".";
+    result.AppendMessage(ss.str().c_str());
+    result.SetStatus(eReturnStatusSuccessFinishResult);
+    return true;
+  }
+};
+
+// Per-function compile latency, from compiler entry to code registration
+class DartJITCompileTimesCommand : public SBCommandPluginInterface {
+public:
+  bool DoExecute(SBDebugger debugger, char **command,
+                 SBCommandReturnObject &result) override {
+    std::string action = (command && command[0]) ? command[0] : "report";
+    SBTarget target = debugger.GetSelectedTarget();
+
+    if (action == "enable") {
+      if (!target.IsValid()) {
+        result.AppendMessage("No valid target selected. Please select a target first.");
+        result.SetStatus(eReturnStatusFailed);
+        return false;
+      }
+      std::vector<std::string> symbols;
+      for (char **arg = command + 1; *arg; ++arg) {
+        symbols.push_back(*arg);
+      }
+      if (symbols.empty()) {
+        symbols.push_back("dart::CompileParsedFunctionHelper::Compile");
+      }
+
+      std::lock_guard<std::mutex> lock(g_compile_mutex);
+      if (!g_compile_bp_ids.empty()) {
+        result.AppendMessage("Compile latency tracking is already enabled.");
+        result.SetStatus(eReturnStatusFailed);
+        return false;
+      }
+      std::stringstream ss;
+      for (const auto &symbol : symbols) {
+        SBBreakpoint bp = target.BreakpointCreateByName(symbol.c_str());
+        if (!bp.IsValid() || bp.GetNumLocations() == 0) {
+          ss << "Warning: no locations for '" << symbol
+             << "' (compiler entry points need a debug VM build).\n";
+          if (bp.IsValid()) {
+            target.BreakpointDelete(bp.GetID());
+          }
+          continue;
+        }
+        SetUpAutoContinueBreakpoint(bp, CompileStartCallback, nullptr,
+                                    "__lldb_internal_dart_compile");
+        g_compile_bp_ids.push_back(bp.GetID());
+        ss << "Timing compiles started at '" << symbol << "'.\n";
+      }
+      result.AppendMessage(ss.str().c_str());
+      result.SetStatus(g_compile_bp_ids.empty() ? eReturnStatusFailed
+                                                : eReturnStatusSuccessFinishResult);
+      return !g_compile_bp_ids.empty();
+    }
+
+    if (action == "disable") {
+      std::lock_guard<std::mutex> lock(g_compile_mutex);
+      for (break_id_t id : g_compile_bp_ids) {
+        if (target.IsValid()) {
+          target.BreakpointDelete(id);
+        }
+      }
+      g_compile_bp_ids.clear();
+      g_compile_starts.clear();
+      result.AppendMessage("Compile latency tracking disabled.");
+      result.SetStatus(eReturnStatusSuccessFinishResult);
+      return true;
+    }
+
+    if (action == "clear") {
+      std::lock_guard<std::mutex> lock(g_compile_mutex);
+      g_compile_us.clear();
+      result.AppendMessage("Compile latencies cleared.");
+      result.SetStatus(eReturnStatusSuccessFinishResult);
+      return true;
+    }
+
+    if (action != "report" && !isdigit(static_cast<unsigned char>(action[0]))) {
+      result.AppendMessage(
+          "Usage: dart-jit compile-times enable [symbol...]\n"
+          "       dart-jit compile-times [report] [N]\n"
+          "       dart-jit compile-times disable | clear\n"
+          "Times each compile from the compiler entry point (default:\n"
+          "dart::CompileParsedFunctionHelper::Compile, debug VM builds) to the\n"
+          "matching __jit_debug_register_code on the same thread.");
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    const char *count_arg = (action == "report") ? command[1] : command[0];
+    size_t top = count_arg ? strtoull(count_arg, nullptr, 0) : 20;
+
+    std::vector<std::pair<uint64_t, uint64_t>> compiles;  // (us, addr)
+    {
+      std::lock_guard<std::mutex> lock(g_compile_mutex);
+      for (const auto &pair : g_compile_us) {
+        compiles.emplace_back(pair.second, pair.first);
+      }
+    }
+    if (compiles.empty()) {
+      result.AppendMessage("No compile latencies recorded. Use 'dart-jit compile-times enable' first.");
+      result.SetStatus(eReturnStatusSuccessFinishResult);
+      return true;
+    }
+    std::sort(compiles.begin(), compiles.end(), std::greater<std::pair<uint64_t, uint64_t>>());
+
+    uint64_t total_us = 0;
+    for (const auto &compile : compiles) {
+      total_us += compile.first;
+    }
+
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(3);
+    ss << "Slowest compiles (" << compiles.size() << " timed, "
+       << total_us / 1e3 << " ms total):\n";
+    ss << "Compile ms  Size     Thread                         Function Name\n";
+    ss << "---------- -------- ------------------------------ ------------------------------\n";
+    std::lock_guard<std::mutex> lock(g_jit_mutex);
+    for (size_t i = 0; i < compiles.size() && i < top; ++i) {
+      uint64_t addr = compiles[i].second;
+      auto size = g_jit_sizes.find(addr);
+      auto name = g_jit_functions.find(addr);
+      ss << std::setw(10) << compiles[i].first / 1e3 << " "
+         << std::setw(8) << (size != g_jit_sizes.end() ? size->second : 0) << " " << std::left
+         << std::setw(30) << RegisteringThreadLabelLocked(addr) << std::right << " "
+         << (name != g_jit_functions.end() ? name->second : "<unknown>") << "\n";
+    }
+    result.AppendMessage(ss.str().c_str());
+    result.SetStatus(eReturnStatusSuccessFinishResult);
+    return true;
+  }
+};
+
+// Live, top-like view of JIT activity and debugger overhead
+class DartJITTopCommand : public SBCommandPluginInterface {
+public:
+  bool DoExecute(SBDebugger debugger, char **command,
+                 SBCommandReturnObject &result) override {
+    uint64_t interval_ms = 1000;
+    uint64_t iterations = 0;
+    for (char **arg = command; arg && *arg; ++arg) {
+      std::string opt = *arg;
+      if (opt == "--interval" && arg[1]) {
+        interval_ms = std::max<uint64_t>(100, strtoull(*++arg, nullptr, 0));
+      } else if (opt == "--iterations" && arg[1]) {
+        iterations = strtoull(*++arg, nullptr, 0);
+      } else {
+        result.AppendMessage(
+            "Usage: dart-jit top [--interval <ms>] [--iterations <n>]\n"
+            "Refreshes until interrupted (Ctrl-C), the process exits or n\n"
+            "refreshes have been shown.");
+        result.SetStatus(eReturnStatusFailed);
+        return false;
+      }
+    }
+
+    SBCommandInterpreter interpreter = debugger.GetCommandInterpreter();
+    Snapshot prev = Take();
+    auto last = std::chrono::steady_clock::now();
+    for (uint64_t n = 0; iterations == 0 || n < iterations; ++n) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+      if (interpreter.WasInterrupted()) {
+        break;
+      }
+      Snapshot cur = Take();
+      auto now = std::chrono::steady_clock::now();
+      double secs = std::chrono::duration<double>(now - last).count();
+      last = now;
+
+      SBProcess process = debugger.GetSelectedTarget().GetProcess();
+      bool alive = process.IsValid() && process.GetState() != eStateExited;
+      std::cout << "\033[2J\033[H" << Render(prev, cur, secs, alive) << std::flush;
+      prev = std::move(cur);
+      if (!alive) {
+        break;
+      }
+    }
+
+    result.SetStatus(eReturnStatusSuccessFinishNoResult);
+    return true;
+  }
+
+private:
+  struct Snapshot {
+    uint64_t registrations;   // registration events, including new versions
+    uint64_t live_functions;  // entries in the registry
+    uint64_t code_bytes;
+    uint64_t registry_bytes;
+    uint64_t samples;
+    uint64_t sample_ns;
+    uint64_t stops[kNumStopCauses];
+    uint64_t callback_ns[kNumStopCauses];
+    std::unordered_map<uint64_t, uint64_t> hot;
+  };
+
+  static Snapshot Take() {
+    Snapshot snap;
+    snap.registrations = g_stat_registrations.load(std::memory_order_relaxed);
+    snap.code_bytes = g_stat_code_bytes.load(std::memory_order_relaxed);
+    snap.registry_bytes = g_stat_registry_bytes.load(std::memory_order_relaxed);
+    snap.samples = g_stat_samples.load(std::memory_order_relaxed);
+    snap.sample_ns = g_stat_sample_ns.load(std::memory_order_relaxed);
+    for (int c = 0; c < kNumStopCauses; ++c) {
+      snap.stops[c] = g_stat_stops[c].load(std::memory_order_relaxed);
+      snap.callback_ns[c] = g_stat_callback_ns[c].load(std::memory_order_relaxed);
+    }
+    {
+      std::lock_guard<std::mutex> lock(g_jit_mutex);
+      snap.live_functions = g_jit_sizes.size();
+    }
+    std::lock_guard<std::mutex> lock(g_sample_mutex);
+    snap.hot = g_hot_samples;
+    return snap;
+  }
+
+  static std::string Render(const Snapshot &prev, const Snapshot &cur, double secs,
+                            bool alive) {
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1);
+    ss << "dart-jit top - process " << (alive ? "alive" : "exited")
+       << ", refreshed every " << secs << " s (Ctrl-C to quit)\n\n";
+    ss << "Registrations/s: " << std::setw(10) << (cur.registrations - prev.registrations) / secs
+       << "   Code KB/s: " << std::setw(10) << (cur.code_bytes - prev.code_bytes) / 1024.0 / secs
+       << "\n";
+    ss << "Registry:        " << std::setw(10) << cur.live_functions << " functions, ~"
+       << cur.registry_bytes / 1024.0 << " KB (" << cur.registrations
+       << " registration events in total)\n\n";
+
+    uint64_t total_ns = 0;
+    ss << "Stops/s by cause:";
+    for (int c = 0; c < kNumStopCauses; ++c) {
+      ss << "  " << kStopCauseNames[c] << " " << (cur.stops[c] - prev.stops[c]) / secs;
+      total_ns += cur.callback_ns[c] - prev.callback_ns[c];
+    }
+    ss << "\nCallback time:    " << total_ns / 1e6 / secs << " ms/s ("
+       << 100.0 * total_ns / 1e9 / secs << "% of wall time)\n";
+    uint64_t sample_ns = cur.sample_ns - prev.sample_ns;
+    ss << "Sampling time:    " << sample_ns / 1e6 / secs << " ms/s ("
+       << 100.0 * sample_ns / 1e9 / secs << "% of wall time)\n\n";
+
+    // Hot functions: samples taken during this interval
+    std::vector<std::pair<uint64_t, uint64_t>> hot;
+    uint64_t interval_samples = 0;
+    for (const auto &pair : cur.hot) {
+      auto it = prev.hot.find(pair.first);
+      uint64_t delta = pair.second - (it != prev.hot.end() ? it->second : 0);
+      if (delta) {
+        hot.emplace_back(delta, pair.first);
+        interval_samples += delta;
+      }
+    }
+    std::sort(hot.begin(), hot.end(), std::greater<std::pair<uint64_t, uint64_t>>());
+    ss << "Hot JIT functions (" << cur.samples - prev.samples << " thread samples, "
+       << interval_samples << " in JIT code):\n";
+    const size_t kHotRows = 15;
+    std::lock_guard<std::mutex> lock(g_jit_mutex);
+    for (size_t i = 0; i < hot.size() && i < kHotRows; ++i) {
+      ss << "  " << std::setw(6) << 100.0 * hot[i].first / interval_samples << "%  "
+         << g_jit_functions[hot[i].second] << "\n";
+    }
+    if (hot.empty()) {
+      ss << "  (no samples in JIT code this interval)\n";
+    }
+    return ss.str();
+  }
+};
+
+// Helper: read a folded-stack profile ("frame;frame;frame count" per line)
+static bool ReadFoldedProfile(const std::string &path,
+                              std::unordered_map<std::string, uint64_t> &stacks) {
+  std::ifstream in(path);
+  if (!in) {
+    return false;
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    size_t space = line.find_last_of(' ');
+    if (space == std::string::npos || space == 0) {
+      continue;
+    }
+    stacks[line.substr(0, space)] += strtoull(line.c_str() + space + 1, nullptr, 10);
+  }
+  return true;
+}
+
+// Helper: split a folded stack into its frames, root first
+static std::vector<std::string> SplitFoldedStack(const std::string &stack) {
+  std::vector<std::string> frames;
+  std::istringstream in(stack);
+  std::string frame;
+  while (std::getline(in, frame, ';')) {
+    frames.push_back(frame);
+  }
+  return frames;
+}
+
+// Minimal protobuf encoder for the pprof profile.proto messages
+class ProtoWriter {
+public:
+  void Varint(uint32_t field, uint64_t value) {
+    Key(field, 0);
+    Raw(value);
+  }
+
+  void Bytes(uint32_t field, const std::string &bytes) {
+    Key(field, 2);
+    Raw(bytes.size());
+    out_ += bytes;
+  }
+
+  void Packed(uint32_t field, const std::vector<uint64_t> &values) {
+    ProtoWriter packed;
+    for (uint64_t v : values) {
+      packed.Raw(v);
+    }
+    Bytes(field, packed.str());
+  }
+
+  const std::string &str() const { return out_; }
+
+private:
+  void Key(uint32_t field, uint32_t wire_type) { Raw((field << 3) | wire_type); }
+
+  void Raw(uint64_t value) {
+    while (value >= 0x80) {
+      out_ += static_cast<char>((value & 0x7F) | 0x80);
+      value >>= 7;
+    }
+    out_ += static_cast<char>(value);
+  }
+
+  std::string out_;
+};
+
+// Helper: write a folded profile as an uncompressed pprof protobuf. JIT
+// frames get the address of the registered function with that name and a
+// synthetic mapping covering the registered code range.
+static bool WritePprofProfile(const std::string &path,
+                              const std::unordered_map<std::string, uint64_t> &stacks) {
+  std::vector<std::string> strings = {""};
+  std::unordered_map<std::string, uint64_t> string_ids = {{"", 0}};
+  auto intern = [&](const std::string &str) {
+    auto it = string_ids.find(str);
+    if (it != string_ids.end()) {
+      return it->second;
+    }
+    string_ids[str] = strings.size();
+    strings.push_back(str);
+    return static_cast<uint64_t>(strings.size() - 1);
+  };
+
+  std::unordered_map<std::string, std::pair<uint64_t, std::string>> registry;  // name -> (addr, file)
+  uint64_t code_start = 0;
+  uint64_t code_end = 0;
+  {
+    std::lock_guard<std::mutex> lock(g_jit_mutex);
+    for (const auto &pair : g_jit_functions) {
+      registry.emplace(pair.second, std::make_pair(pair.first, g_jit_files[pair.first]));
+    }
+    if (!g_jit_sizes.empty()) {
+      code_start = g_jit_sizes.begin()->first;
+      code_end = g_jit_sizes.rbegin()->first + g_jit_sizes.rbegin()->second;
+    }
+  }
+
+  ProtoWriter profile;
+  ProtoWriter sample_type;
+  sample_type.Varint(1, intern("samples"));
+  sample_type.Varint(2, intern("count"));
+  profile.Bytes(1, sample_type.str());
+
+  std::unordered_map<std::string, uint64_t> location_ids;
+  std::string locations;
+  for (const auto &pair : stacks) {
+    std::vector<std::string> frames = SplitFoldedStack(pair.first);
+    std::vector<uint64_t> ids;
+    for (auto it = frames.rbegin(); it != frames.rend(); ++it) {
+      auto loc = location_ids.find(*it);
+      if (loc == location_ids.end()) {
+        uint64_t id = location_ids.size() + 1;
+        loc = location_ids.emplace(*it, id).first;
+
+        auto reg = registry.find(*it);
+        ProtoWriter function;
+        function.Varint(1, id);
+        function.Varint(2, intern(*it));
+        function.Varint(3, intern(*it));
+        if (reg != registry.end()) {
+          function.Varint(4, intern(reg->second.second));
+        }
+        profile.Bytes(5, function.str());
+
+        ProtoWriter line;
+        line.Varint(1, id);
+        ProtoWriter location;
+        location.Varint(1, id);
+        if (reg != registry.end()) {
+          location.Varint(2, 1);
+          location.Varint(3, reg->second.first);
+        }
+        location.Bytes(4, line.str());
+        profile.Bytes(4, location.str());
+      }
+      ids.push_back(loc->second);
+    }
+    ProtoWriter sample;
+    sample.Packed(1, ids);
+    sample.Packed(2, {pair.second});
+    profile.Bytes(2, sample.str());
+  }
+
+  ProtoWriter mapping;
+  mapping.Varint(1, 1);
+  mapping.Varint(2, code_start);
+  mapping.Varint(3, code_end);
+  mapping.Varint(5, intern("[dart-jit]"));
+  mapping.Varint(7, 1);  // has_functions
+  profile.Bytes(3, mapping.str());
+
+  for (const auto &str : strings) {
+    profile.Bytes(6, str);
+  }
+
+  std::ofstream out(path, std::ios::binary);
+  out << profile.str();
+  return static_cast<bool>(out);
+}
+
+// Record, save, export and compare sampling profiles
+class DartJITProfileCommand : public SBCommandPluginInterface {
+public:
+  bool DoExecute(SBDebugger debugger, char **command,
+                 SBCommandReturnObject &result) override {
+    std::string action = (command && command[0]) ? command[0] : "";
+
+    if (action == "start") {
+      if (command[1]) {
+        uint64_t interval_ms = std::max<uint64_t>(1, strtoull(command[1], nullptr, 0));
+        g_profile_interval_us = interval_ms * 1000;
+      }
+      g_profile_recording = true;
+      std::stringstream ss;
+      ss << "Recording stacks every " << g_profile_interval_us / 1000
+         << " ms on the stops the plugin takes.";
+      result.AppendMessage(ss.str().c_str());
+      result.SetStatus(eReturnStatusSuccessFinishResult);
+      return true;
+    }
+
+    if (action == "stop") {
+      g_profile_recording = false;
+      result.AppendMessage("Profile recording stopped.");
+      result.SetStatus(eReturnStatusSuccessFinishResult);
+      return true;
+    }
+
+    if (action == "save" && command[1]) {
+      std::unordered_map<std::string, uint64_t> stacks;
+      {
+        std::lock_guard<std::mutex> lock(g_sample_mutex);
+        stacks = g_profile_stacks;
+      }
+      std::ofstream out(command[1]);
+      for (const auto &pair : stacks) {
+        out << pair.first << " " << pair.second << "\n";
+      }
+      if (!out) {
+        return Fail(result, std::string("Cannot write ") + command[1]);
+      }
+      std::stringstream ss;
+      ss << "Saved " << stacks.size() << " distinct stacks to " << command[1] << ".";
+      result.AppendMessage(ss.str().c_str());
+      result.SetStatus(eReturnStatusSuccessFinishResult);
+      return true;
+    }
+
+    if (action == "export" && command[1] && command[2]) {
+      std::unordered_map<std::string, uint64_t> stacks;
+      if (!ReadFoldedProfile(command[1], stacks)) {
+        return Fail(result, std::string("Cannot read ") + command[1]);
+      }
+      if (!WritePprofProfile(command[2], stacks)) {
+        return Fail(result, std::string("Cannot write ") + command[2]);
+      }
+      std::stringstream ss;
+      ss << "Wrote pprof profile to " << command[2]
+         << " (compare runs with 'pprof -diff_base=<a.pb> <b.pb>').";
+      result.AppendMessage(ss.str().c_str());
+      result.SetStatus(eReturnStatusSuccessFinishResult);
+      return true;
+    }
+
+    if (action == "diff" && command[1] && command[2]) {
+      return Diff(command + 1, result);
+    }
+
+    result.AppendMessage(
+        "Usage: dart-jit profile start [interval-ms] | stop\n"
+        "       dart-jit profile save <file.folded>\n"
+        "       dart-jit profile diff <a.folded> <b.folded> [--flame <out>] [--top N]\n"
+        "       dart-jit profile export <file.folded> <out.pb>\n"
+        "Profiles are folded stacks keyed by function name, so runs with\n"
+        "different JIT addresses can be compared. --flame writes the\n"
+        "'stack count_a count_b' format that flamegraph.pl renders as a\n"
+        "differential flame graph.");
+    result.SetStatus(eReturnStatusFailed);
+    return false;
+  }
+
+private:
+  bool Fail(SBCommandReturnObject &result, const std::string &msg) {
+    result.AppendMessage(msg.c_str());
+    result.SetStatus(eReturnStatusFailed);
+    return false;
+  }
+
+  bool Diff(char **args, SBCommandReturnObject &result) {
+    std::unordered_map<std::string, uint64_t> a;
+    std::unordered_map<std::string, uint64_t> b;
+    if (!ReadFoldedProfile(args[0], a)) {
+      return Fail(result, std::string("Cannot read ") + args[0]);
+    }
+    if (!ReadFoldedProfile(args[1], b)) {
+      return Fail(result, std::string("Cannot read ") + args[1]);
+    }
+    std::string flame_path;
+    size_t top = 20;
+    for (char **arg = args + 2; *arg; ++arg) {
+      std::string opt = *arg;
+      if (opt == "--flame" && arg[1]) {
+        flame_path = *++arg;
+      } else if (opt == "--top" && arg[1]) {
+        top = strtoull(*++arg, nullptr, 0);
+      }
+    }
+
+    // Self time per function (leaf frame), normalized by each run's total
+    auto self_times = [](const std::unordered_map<std::string, uint64_t> &stacks,
+                         std::unordered_map<std::string, uint64_t> &self) {
+      uint64_t total = 0;
+      for (const auto &pair : stacks) {
+        size_t semi = pair.first.find_last_of(';');
+        self[semi == std::string::npos ? pair.first : pair.first.substr(semi + 1)] += pair.second;
+        total += pair.second;
+      }
+      return std::max<uint64_t>(1, total);
+    };
+    std::unordered_map<std::string, uint64_t> self_a;
+    std::unordered_map<std::string, uint64_t> self_b;
+    uint64_t total_a = self_times(a, self_a);
+    uint64_t total_b = self_times(b, self_b);
+
+    struct Row {
+      std::string name;
+      double pct_a;
+      double pct_b;
+    };
+    std::vector<Row> rows;
+    for (const auto &pair : self_a) {
+      auto it = self_b.find(pair.first);
+      rows.push_back(Row{pair.first, 100.0 * pair.second / total_a,
+                         it != self_b.end() ? 100.0 * it->second / total_b : 0.0});
+    }
+    for (const auto &pair : self_b) {
+      if (!self_a.count(pair.first)) {
+        rows.push_back(Row{pair.first, 0.0, 100.0 * pair.second / total_b});
+      }
+    }
+    std::sort(rows.begin(), rows.end(), [](const Row &x, const Row &y) {
+      return std::abs(x.pct_b - x.pct_a) > std::abs(y.pct_b - y.pct_a);
+    });
+
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(2);
+    ss << "Self-time changes (" << total_a << " samples in " << args[0] << ", "
+       << total_b << " in " << args[1] << "):\n";
+    ss << "   Delta%   Before%    After%  Function Name\n";
+    ss << "--------- --------- ---------  ------------------------------\n";
+    for (size_t i = 0; i < rows.size() && i < top; ++i) {
+      ss << std::showpos << std::setw(9) << rows[i].pct_b - rows[i].pct_a << std::noshowpos
+         << " " << std::setw(9) << rows[i].pct_a << " " << std::setw(9) << rows[i].pct_b
+         << "  " << rows[i].name << "\n";
+    }
+
+    if (!flame_path.empty()) {
+      // Scale run a to run b's sample count so widths are comparable
+      std::ofstream out(flame_path);
+      double scale = static_cast<double>(total_b) / total_a;
+      for (const auto &pair : a) {
+        auto it = b.find(pair.first);
+        out << pair.first << " " << static_cast<uint64_t>(pair.second * scale + 0.5) << " "
+            << (it != b.end() ? it->second : 0) << "\n";
+      }
+      for (const auto &pair : b) {
+        if (!a.count(pair.first)) {
+          out << pair.first << " 0 " << pair.second << "\n";
+        }
+      }
+      if (!out) {
+        return Fail(result, "Cannot write " + flame_path);
+      }
+      ss << "\nDifferential folded stacks written to " << flame_path
+         << " (render with 'flamegraph.pl').";
+    }
+
+    result.AppendMessage(ss.str().c_str());
+    result.SetStatus(eReturnStatusSuccessFinishResult);
+    return true;
+  }
+};
+
+// A registered function whose code has been fetched from the inferior
+struct JITCodeBody {
+  uint64_t addr;
+  uint64_t size;
+  std::string name;
+  std::vector<uint8_t> bytes;
+};
+
+// Helper: fetch the code of every registered function (optionally only those
+// whose name contains filter, or only the given start addresses). Neighbouring
+// functions are coalesced into large spans so the inferior is read with few
+// bulk reads, in parallel.
+static std::vector<JITCodeBody> FetchJITCode(SBProcess &process, const std::string &filter = "",
+                                             const std::unordered_set<uint64_t> *only = nullptr) {
+  std::vector<JITCodeBody> bodies;
+  {
+    std::lock_guard<std::mutex> lock(g_jit_mutex);
+    for (const auto &pair : g_jit_sizes) {
+      if (only && !only->count(pair.first)) {
+        continue;
+      }
+      const std::string &name = g_jit_functions[pair.first];
+      if (pair.second != 0 && name.find(filter) != std::string::npos) {
+        bodies.push_back(JITCodeBody{pair.first, pair.second, name, {}});
+      }
+    }
+  }
+
+  // Spans of [first, last] body indices, split at large gaps or sizes
+  const uint64_t kMaxGap = 64 * 1024;
+  const uint64_t kMaxSpan = 8 * 1024 * 1024;
+  std::vector<std::pair<size_t, size_t>> spans;
+  for (size_t i = 0; i < bodies.size(); ++i) {
+    if (!spans.empty()) {
+      const JITCodeBody &first = bodies[spans.back().first];
+      const JITCodeBody &prev = bodies[i - 1];
+      if (bodies[i].addr <= prev.addr + prev.size + kMaxGap &&
+          bodies[i].addr + bodies[i].size - first.addr <= kMaxSpan) {
+        spans.back().second = i;
+        continue;
+      }
+    }
+    spans.emplace_back(i, i);
+  }
+
+  ParallelFor(spans.size(), DefaultWorkerCount(), [&](size_t, size_t index) {
+    size_t first = spans[index].first;
+    size_t last = spans[index].second;
+    uint64_t start = bodies[first].addr;
+    uint64_t end = 0;
+    for (size_t i = first; i <= last; ++i) {
+      end = std::max(end, bodies[i].addr + bodies[i].size);
+    }
+    std::vector<uint8_t> span(end - start);
+    SBError error;
+    if (process.ReadMemory(start, span.data(), span.size(), error) != span.size()) {
+      return;
+    }
+    for (size_t i = first; i <= last; ++i) {
+      auto begin = span.begin() + (bodies[i].addr - start);
+      bodies[i].bytes.assign(begin, begin + bodies[i].size);
+    }
+  });
+
+  bodies.erase(std::remove_if(bodies.begin(), bodies.end(),
+                              [](const JITCodeBody &body) { return body.bytes.empty(); }),
+               bodies.end());
+  return bodies;
+}
+
+// Helper: 64-bit FNV-1a
+static uint64_t HashBytes(const uint8_t *data, size_t size) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ data[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+// Helper: blank out the parts of an instruction stream that change when the
+// same code is placed at another address: pc-relative branch and page
+// offsets, and absolute addresses pointing into JIT code.
+static void MaskRelocations(std::vector<uint8_t> &code, bool is_arm64,
+                            uint64_t code_min, uint64_t code_max) {
+  if (is_arm64) {
+    for (size_t i = 0; i + 4 <= code.size(); i += 4) {
+      uint32_t insn;
+      memcpy(&insn, &code[i], 4);
+      if ((insn & 0x7C000000) == 0x14000000) {         // B, BL
+        insn &= 0xFC000000;
+      } else if ((insn & 0x9F000000) == 0x90000000 ||  // ADRP
+                 (insn & 0x9F000000) == 0x10000000) {  // ADR
+        insn &= 0x9F00001F;
+      } else if ((insn & 0xFF000010) == 0x54000000 ||  // B.cond
+                 (insn & 0x7E000000) == 0x34000000 ||  // CBZ, CBNZ
+                 (insn & 0x3B000000) == 0x18000000) {  // LDR (literal)
+        insn &= 0xFF00001F;
+      }
+      memcpy(&code[i], &insn, 4);
+    }
+    return;
+  }
+
+  // x86: rel32 of CALL, JMP and Jcc, then absolute 64-bit JIT addresses
+  for (size_t i = 0; i < code.size(); ++i) {
+    size_t imm = 0;
+    if (code[i] == 0xE8 || code[i] == 0xE9) {
+      imm = i + 1;
+    } else if (code[i] == 0x0F && i + 1 < code.size() && (code[i + 1] & 0xF0) == 0x80) {
+      imm = i + 2;
+    }
+    if (imm && imm + 4 <= code.size()) {
+      memset(&code[imm], 0, 4);
+      i = imm + 3;
+    }
+  }
+  for (size_t i = 0; i + 8 <= code.size(); ++i) {
+    uint64_t value;
+    memcpy(&value, &code[i], 8);
+    if (value >= code_min && value < code_max) {
+      memset(&code[i], 0, 8);
+      i += 7;
+    }
+  }
+}
+
+// Find identical and near-identical (same code modulo relocations) bodies
+class DartJITDupesCommand : public SBCommandPluginInterface {
+public:
+  bool DoExecute(SBDebugger debugger, char **command,
+                 SBCommandReturnObject &result) override {
+    size_t top = (command && command[0]) ? strtoull(command[0], nullptr, 0) : 20;
+
+    SBTarget target = debugger.GetSelectedTarget();
+    SBProcess process = target.GetProcess();
+    if (!target.IsValid() || !process.IsValid()) {
+      result.AppendMessage("No valid process. Please run the program first.");
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    std::vector<JITCodeBody> bodies = FetchJITCode(process);
+    if (bodies.empty()) {
+      result.AppendMessage("No JIT code could be read.");
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    const char *triple = target.GetTriple();
+    bool is_arm64 = triple && (strncmp(triple, "aarch64", 7) == 0 || strncmp(triple, "arm64", 5) == 0);
+    uint64_t code_min = bodies.front().addr;
+    uint64_t code_max = bodies.back().addr + bodies.back().size;
+
+    std::vector<uint64_t> norm_hash(bodies.size());
+    ParallelFor(bodies.size(), DefaultWorkerCount(), [&](size_t, size_t i) {
+      std::vector<uint8_t> code = bodies[i].bytes;
+      MaskRelocations(code, is_arm64, code_min, code_max);
+      norm_hash[i] = HashBytes(code.data(), code.size());
+    });
+
+    std::map<std::pair<uint64_t, uint64_t>, std::vector<size_t>> buckets;  // (size, hash)
+    for (size_t i = 0; i < bodies.size(); ++i) {
+      buckets[std::make_pair(bodies[i].size, norm_hash[i])].push_back(i);
+    }
+
+    // A hash bucket is only a candidate: split it into clusters whose masked
+    // bytes really are equal. A cluster is "identical" when every member's
+    // raw bytes match, else "relocated".
+    struct Cluster {
+      uint64_t wasted;
+      bool identical;
+      std::vector<size_t> members;
+    };
+    std::vector<Cluster> dupes;
+    uint64_t total_wasted = 0;
+    for (const auto &pair : buckets) {
+      const std::vector<size_t> &candidates = pair.second;
+      if (candidates.size() < 2) {
+        continue;
+      }
+      std::vector<std::vector<uint8_t>> masked;
+      std::vector<Cluster> split;
+      for (size_t i : candidates) {
+        std::vector<uint8_t> code = bodies[i].bytes;
+        MaskRelocations(code, is_arm64, code_min, code_max);
+        size_t c = 0;
+        while (c < split.size() && masked[c] != code) {
+          ++c;
+        }
+        if (c == split.size()) {
+          masked.push_back(std::move(code));
+          split.push_back(Cluster{0, true, {}});
+        } else if (bodies[i].bytes != bodies[split[c].members[0]].bytes) {
+          split[c].identical = false;
+        }
+        split[c].members.push_back(i);
+      }
+      for (auto &cluster : split) {
+        if (cluster.members.size() < 2) {
+          continue;
+        }
+        cluster.wasted = (cluster.members.size() - 1) * pair.first.first;
+        total_wasted += cluster.wasted;
+        dupes.push_back(std::move(cluster));
+      }
+    }
+    std::sort(dupes.begin(), dupes.end(), [](const Cluster &a, const Cluster &b) {
+      return a.wasted > b.wasted;
+    });
+
+    uint64_t total_bytes = 0;
+    for (const auto &body : bodies) {
+      total_bytes += body.size;
+    }
+
+    std::stringstream ss;
+    ss << "Duplicate JIT code: " << dupes.size() << " cluster(s), " << total_wasted
+       << " of " << total_bytes << " bytes wasted across " << bodies.size()
+       << " functions.\n";
+    ss << "Copies   Size     Wasted     Kind      Functions\n";
+    ss << "-------- -------- ---------- --------- ------------------------------\n";
+    for (size_t c = 0; c < dupes.size() && c < top; ++c) {
+      const Cluster &cluster = dupes[c];
+      const size_t kShownNames = 3;
+      ss << std::left << std::setw(8) << cluster.members.size() << " "
+         << std::setw(8) << bodies[cluster.members[0]].size << " "
+         << std::setw(10) << cluster.wasted << " "
+         << std::setw(9) << (cluster.identical ? "identical" : "relocated") << " ";
+      for (size_t m = 0; m < cluster.members.size() && m < kShownNames; ++m) {
+        ss << (m ? ", " : "") << bodies[cluster.members[m]].name;
+      }
+      if (cluster.members.size() > kShownNames) {
+        ss << ", ... (+" << cluster.members.size() - kShownNames << ")";
+      }
+      ss << "\n";
+    }
+    if (!dupes.empty()) {
+      ss << "Kind applies to the whole cluster: 'identical' means every copy has the\n"
+         << "same bytes, 'relocated' that some copies differ only in relocations.\n";
+    }
+
+    result.AppendMessage(ss.str().c_str());
+    result.SetStatus(eReturnStatusSuccessFinishResult);
+    return true;
+  }
+};
+
+// Instruction mix of one function
+struct CodegenStats {
+  uint64_t insns = 0;
+  uint64_t bytes = 0;
+  uint64_t calls = 0;
+  uint64_t stub_calls = 0;
+  uint64_t spills = 0;
+  uint64_t reloads = 0;
+  uint64_t branches = 0;
+  uint64_t pool_loads = 0;
+
+  void Add(const CodegenStats &other) {
+    insns += other.insns;
+    bytes += other.bytes;
+    calls += other.calls;
+    stub_calls += other.stub_calls;
+    spills += other.spills;
+    reloads += other.reloads;
+    branches += other.branches;
+    pool_loads += other.pool_loads;
+  }
+};
+
+// Decoded results per function start, reused while the code bytes (by hash)
+// stay the same
+static std::mutex g_codegen_mutex;
+static std::unordered_map<uint64_t, std::pair<uint64_t, CodegenStats>> g_codegen_cache;
+
+// Register conventions the Dart VM uses for generated code
+struct DartCodegenRegs {
+  const char *frame;       // frame pointer, spill slots live below it
+  const char *frame_alt;   // alternate spelling in disassembly, if any
+  const char *stack;       // stack pointer
+  const char *thread;      // THR, holds stub and runtime entry points
+  const char *pool;        // PP, the object pool
+};
+static const DartCodegenRegs kX64Regs = {"[rbp", nullptr, "[rsp", "[r14", "[r15"};
+static const DartCodegenRegs kArm64Regs = {"[x29", "[fp", "[sp", "[x26", "[x27"};
+
+// Helper: classify the instructions of one function. code_ranges is a
+// sorted snapshot of (start, end, is_stub) used to resolve call targets.
+static CodegenStats ClassifyInstructions(
+    SBTarget &target, const JITCodeBody &body, bool is_arm64,
+    const std::vector<std::tuple<uint64_t, uint64_t, bool>> &code_ranges) {
+  const DartCodegenRegs &regs = is_arm64 ? kArm64Regs : kX64Regs;
+  CodegenStats stats;
+  stats.bytes = body.size;
+
+  SBInstructionList insns =
+      DisassembleJITCode(target, body.addr, body.bytes.data(), body.bytes.size());
+  for (size_t i = 0; i < insns.GetSize(); ++i) {
+    SBInstruction insn = insns.GetInstructionAtIndex(i);
+    std::string mnemonic = insn.GetMnemonic(target) ? insn.GetMnemonic(target) : "";
+    std::string operands = insn.GetOperands(target) ? insn.GetOperands(target) : "";
+    stats.insns++;
+
+    bool is_call = is_arm64 ? (mnemonic == "bl" || mnemonic == "blr")
+                            : mnemonic.compare(0, 4, "call") == 0;
+    if (is_call) {
+      stats.calls++;
+      uint64_t dest = 0;
+      bool stub = operands.find(regs.thread) != std::string::npos;
+      if (!stub && ParseDirectBranchTarget(operands.c_str(), dest)) {
+        auto it = std::upper_bound(code_ranges.begin(), code_ranges.end(),
+                                   std::make_tuple(dest, UINT64_MAX, true));
+        stub = it != code_ranges.begin() && dest < std::get<1>(*(it - 1)) &&
+               std::get<2>(*(it - 1));
+      }
+      stats.stub_calls += stub;
+      continue;
+    }
+
+    bool is_return = mnemonic.compare(0, 3, "ret") == 0;
+    if (insn.DoesBranch() && !is_return) {
+      stats.branches++;
+      continue;
+    }
+
+    size_t mem = operands.find('[');
+    if (mem == std::string::npos) {
+      continue;
+    }
+    if (operands.find(regs.pool) != std::string::npos) {
+      stats.pool_loads++;
+      continue;
+    }
+    bool frame_slot = operands.find(regs.frame) != std::string::npos ||
+                      (regs.frame_alt && operands.find(regs.frame_alt) != std::string::npos) ||
+                      operands.find(regs.stack) != std::string::npos;
+    if (!frame_slot) {
+      continue;
+    }
+    if (is_arm64) {
+      if (mnemonic.compare(0, 2, "st") == 0) {
+        stats.spills++;
+      } else if (mnemonic.compare(0, 2, "ld") == 0) {
+        stats.reloads++;
+      }
+    } else if (mnemonic.compare(0, 3, "mov") == 0) {
+      // Intel syntax (see DisassembleJITCode): a memory destination comes first
+      if (mem < operands.find(',')) {
+        stats.spills++;
+      } else {
+        stats.reloads++;
+      }
+    }
+  }
+  return stats;
+}
+
+// Instruction-mix and codegen-quality statistics over all JIT code
+class DartJITCodegenStatsCommand : public SBCommandPluginInterface {
+public:
+  bool DoExecute(SBDebugger debugger, char **command,
+                 SBCommandReturnObject &result) override {
+    bool by_file = false;
+    size_t top = 20;
+    std::string sort_key = "spills";
+    for (char **arg = command; arg && *arg; ++arg) {
+      std::string opt = *arg;
+      if (opt == "--by" && arg[1]) {
+        by_file = std::string(*++arg) == "file";
+      } else if (opt == "--top" && arg[1]) {
+        top = strtoull(*++arg, nullptr, 0);
+      } else if (opt == "--sort" && arg[1]) {
+        sort_key = *++arg;
+      } else {
+        result.AppendMessage(
+            "Usage: dart-jit codegen-stats [--by fn|file] [--top N]\n"
+            "                              [--sort spills|reloads|calls|stubs|branches|pool]\n"
+            "Disassembles every registered function and classifies calls, stub\n"
+            "calls, spills and reloads of stack slots, branches and object-pool\n"
+            "loads. Ratios are per 100 instructions.");
+        result.SetStatus(eReturnStatusFailed);
+        return false;
+      }
+    }
+
+    SBTarget target = debugger.GetSelectedTarget();
+    SBProcess process = target.GetProcess();
+    if (!target.IsValid() || !process.IsValid()) {
+      result.AppendMessage("No valid process. Please run the program first.");
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    std::vector<JITCodeBody> bodies = FetchJITCode(process);
+    std::vector<std::tuple<uint64_t, uint64_t, bool>> code_ranges;
+    std::unordered_map<uint64_t, std::string> files;
+    {
+      std::lock_guard<std::mutex> lock(g_jit_mutex);
+      for (const auto &pair : g_jit_sizes) {
+        code_ranges.emplace_back(pair.first, pair.first + pair.second,
+                                 IsStubEntryLocked(pair.first));
+      }
+      if (by_file) {
+        for (const auto &body : bodies) {
+          files[body.addr] = g_jit_files[body.addr];
+        }
+      }
+    }
+
+    const char *triple = target.GetTriple();
+    bool is_arm64 = triple && (strncmp(triple, "aarch64", 7) == 0 || strncmp(triple, "arm64", 5) == 0);
+
+    std::vector<CodegenStats> stats(bodies.size());
+    std::atomic<size_t> decoded(0);
+    ParallelFor(bodies.size(), DefaultWorkerCount(), [&](size_t, size_t i) {
+      const JITCodeBody &body = bodies[i];
+      uint64_t hash = HashBytes(body.bytes.data(), body.bytes.size());
+      {
+        std::lock_guard<std::mutex> lock(g_codegen_mutex);
+        auto it = g_codegen_cache.find(body.addr);
+        if (it != g_codegen_cache.end() && it->second.first == hash) {
+          stats[i] = it->second.second;
+          return;
+        }
+      }
+      stats[i] = ClassifyInstructions(target, body, is_arm64, code_ranges);
+      ++decoded;
+      std::lock_guard<std::mutex> lock(g_codegen_mutex);
+      g_codegen_cache[body.addr] = std::make_pair(hash, stats[i]);
+    });
+
+    // Group per function or per source file
+    std::map<std::string, CodegenStats> groups;
+    CodegenStats total;
+    for (size_t i = 0; i < bodies.size(); ++i) {
+      groups[by_file ? files[bodies[i].addr] : bodies[i].name].Add(stats[i]);
+      total.Add(stats[i]);
+    }
+    if (total.insns == 0) {
+      result.AppendMessage("No JIT code could be disassembled.");
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    auto key = [&](const CodegenStats &st) -> double {
+      uint64_t value = st.spills;
+      if (sort_key == "reloads") {
+        value = st.reloads;
+      } else if (sort_key == "calls") {
+        value = st.calls;
+      } else if (sort_key == "stubs") {
+        value = st.stub_calls;
+      } else if (sort_key == "branches") {
+        value = st.branches;
+      } else if (sort_key == "pool") {
+        value = st.pool_loads;
+      }
+      return static_cast<double>(value) / std::max<uint64_t>(1, st.insns);
+    };
+    std::vector<std::pair<std::string, CodegenStats>> rows(groups.begin(), groups.end());
+    std::sort(rows.begin(), rows.end(), [&](const auto &a, const auto &b) {
+      return key(a.second) != key(b.second) ? key(a.second) > key(b.second)
+                                            : a.second.insns > b.second.insns;
+    });
+
+    auto ratios = [](std::stringstream &ss, const CodegenStats &st) {
+      double per = 100.0 / std::max<uint64_t>(1, st.insns);
+      ss << std::setw(8) << st.insns << " " << std::setw(6) << st.calls * per << " "
+         << std::setw(6) << st.stub_calls * per << " " << std::setw(6) << st.spills * per << " "
+         << std::setw(6) << st.reloads * per << " " << std::setw(6) << st.branches * per << " "
+         << std::setw(6) << st.pool_loads * per;
+    };
+
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1);
+    ss << "Codegen statistics for " << bodies.size() << " functions (" << decoded
+       << " decoded, " << bodies.size() - decoded << " cached):\n";
+    ss << "   Insns  Calls  Stubs  Spill Reload Branch   Pool  "
+       << (by_file ? "Source File" : "Function Name") << "\n";
+    ss << "-------- ------ ------ ------ ------ ------ ------  ------------------------------\n";
+    ratios(ss, total);
+    ss << "  (all)\n";
+    for (size_t i = 0; i < rows.size() && i < top; ++i) {
+      ratios(ss, rows[i].second);
+      ss << "  " << rows[i].first << "\n";
+    }
+
+    result.AppendMessage(ss.str().c_str());
+    result.SetStatus(eReturnStatusSuccessFinishResult);
+    return true;
+  }
+};
+
+// Helper: parse "e8 ?? ?? ?? ??" / "e8????????" into bytes plus a mask that
+// is 0 for wildcard bytes. At least one byte must be fixed.
+static bool ParseBytePattern(const std::string &text, std::vector<uint8_t> &bytes,
+                             std::vector<uint8_t> &mask) {
+  std::string digits;
+  for (char c : text) {
+    if (!isspace(static_cast<unsigned char>(c))) {
+      digits += c;
+    }
+  }
+  if (digits.compare(0, 2, "0x") == 0) {
+    digits.erase(0, 2);
+  }
+  if (digits.empty() || digits.size() % 2 != 0) {
+    return false;
+  }
+  bool any_fixed = false;
+  for (size_t i = 0; i < digits.size(); i += 2) {
+    std::string pair = digits.substr(i, 2);
+    if (pair == "??") {
+      bytes.push_back(0);
+      mask.push_back(0);
+      continue;
+    }
+    if (!isxdigit(static_cast<unsigned char>(pair[0])) ||
+        !isxdigit(static_cast<unsigned char>(pair[1]))) {
+      return false;
+    }
+    bytes.push_back(static_cast<uint8_t>(strtoul(pair.c_str(), nullptr, 16)));
+    mask.push_back(0xff);
+    any_fixed = true;
+  }
+  return any_fixed;
+}
+
+// Helper: offsets of every match of a masked byte pattern in data. Candidates
+// are found by comparing the first and last fixed bytes 16 positions at a time
+// (SSE2), or with memchr on the first fixed byte elsewhere, then verified.
+static void ScanBytePattern(const uint8_t *data, size_t size, const std::vector<uint8_t> &bytes,
+                            const std::vector<uint8_t> &mask, std::vector<uint64_t> &hits) {
+  size_t n = bytes.size();
+  if (size < n) {
+    return;
+  }
+  size_t first = 0;
+  while (!mask[first]) {
+    ++first;
+  }
+  size_t last = n - 1;
+  while (!mask[last]) {
+    --last;
+  }
+  auto verify = [&](size_t at) {
+    for (size_t k = 0; k < n; ++k) {
+      if ((data[at + k] ^ bytes[k]) & mask[k]) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  size_t limit = size - n;  // last valid start offset
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i first_byte = _mm_set1_epi8(static_cast<char>(bytes[first]));
+  const __m128i last_byte = _mm_set1_epi8(static_cast<char>(bytes[last]));
+  for (; i + 16 <= limit + 1; i += 16) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + first));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + last));
+    unsigned bits = static_cast<unsigned>(_mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(a, first_byte), _mm_cmpeq_epi8(b, last_byte))));
+    while (bits) {
+      size_t at = i + __builtin_ctz(bits);
+      if (verify(at)) {
+        hits.push_back(at);
+      }
+      bits &= bits - 1;
+    }
+  }
+#endif
+  while (i <= limit) {
+    const void *p = memchr(data + i + first, bytes[first], limit - i + 1);
+    if (!p) {
+      break;
+    }
+    size_t at = static_cast<const uint8_t *>(p) - data - first;
+    if (verify(at)) {
+      hits.push_back(at);
+    }
+    i = at + 1;
+  }
+}
+
+// One dart-jit grep hit
+struct GrepMatch {
+  uint64_t addr;
+  std::string text;
+};
+
+// Search all JIT code for byte sequences or decoded instruction patterns
+class DartJITGrepCommand : public SBCommandPluginInterface {
+public:
+  bool DoExecute(SBDebugger debugger, char **command,
+                 SBCommandReturnObject &result) override {
+    bool insn_mode = false;
+    std::string filter;
+    std::string call_target;
+    size_t limit = 100;
+    std::string pattern;
+    for (char **arg = command; arg && *arg; ++arg) {
+      std::string opt = *arg;
+      if (opt == "--insn") {
+        insn_mode = true;
+      } else if (opt == "--fn" && arg[1]) {
+        filter = *++arg;
+      } else if (opt == "--calls-to" && arg[1]) {
+        insn_mode = true;
+        call_target = *++arg;
+      } else if (opt == "--limit" && arg[1]) {
+        limit = strtoull(*++arg, nullptr, 0);
+      } else if (opt.compare(0, 2, "--") == 0) {
+        pattern.clear();
+        break;
+      } else {
+        pattern += (pattern.empty() ? "" : " ") + opt;
+      }
+    }
+    if (pattern.empty() && call_target.empty()) {
+      result.AppendMessage(
+          "Usage: dart-jit grep [--fn name] [--limit N] <hex-bytes>\n"
+          "       dart-jit grep [--fn name] [--limit N] --insn <pattern>\n"
+          "       dart-jit grep [--fn name] [--limit N] --calls-to <function>\n"
+          "Hex bytes may use ?? wildcards (e.g. \"e8 ?? ?? ?? ??\"). An instruction\n"
+          "pattern is a glob over \"mnemonic operands\" in Intel syntax on x86\n"
+          "(e.g. \"mov* *0x2a*\").\n"
+          "--calls-to finds direct branches into the named function or stub.");
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    std::vector<uint8_t> bytes;
+    std::vector<uint8_t> mask;
+    if (!insn_mode && !ParseBytePattern(pattern, bytes, mask)) {
+      result.AppendMessage("Invalid byte pattern: use hex bytes with optional ?? wildcards.");
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+    uint64_t target_addr = 0;
+    uint64_t target_size = 0;
+    std::string target_name;
+    if (!call_target.empty() &&
+        !FindJITFunctionByName(call_target, target_addr, target_size, target_name)) {
+      std::string msg = "Function '" + call_target + "' not found in JIT-compiled code.";
+      result.AppendMessage(msg.c_str());
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    SBTarget target = debugger.GetSelectedTarget();
+    SBProcess process = target.GetProcess();
+    if (!target.IsValid() || !process.IsValid()) {
+      result.AppendMessage("No valid process. Please run the program first.");
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    std::vector<JITCodeBody> bodies = FetchJITCode(process, filter);
+    std::vector<std::vector<GrepMatch>> matches(bodies.size());
+    std::atomic<uint64_t> scanned(0);
+    ParallelFor(bodies.size(), DefaultWorkerCount(), [&](size_t, size_t i) {
+      const JITCodeBody &body = bodies[i];
+      scanned += body.size;
+      if (!insn_mode) {
+        std::vector<uint64_t> hits;
+        ScanBytePattern(body.bytes.data(), body.bytes.size(), bytes, mask, hits);
+        for (uint64_t offset : hits) {
+          matches[i].push_back(GrepMatch{body.addr + offset, ""});
+        }
+        return;
+      }
+      SBInstructionList insns =
+          DisassembleJITCode(target, body.addr, body.bytes.data(), body.bytes.size());
+      for (size_t k = 0; k < insns.GetSize(); ++k) {
+        SBInstruction insn = insns.GetInstructionAtIndex(k);
+        const char *mnemonic = insn.GetMnemonic(target);
+        const char *operands = insn.GetOperands(target);
+        std::string text = std::string(mnemonic ? mnemonic : "") + " " + (operands ? operands : "");
+        bool hit = false;
+        if (!call_target.empty()) {
+          uint64_t dest = 0;
+          hit = insn.DoesBranch() && ParseDirectBranchTarget(operands, dest) &&
+                dest >= target_addr && dest < target_addr + target_size;
+        }
+        if (!pattern.empty() && (call_target.empty() || hit)) {
+          hit = fnmatch(pattern.c_str(), text.c_str(), 0) == 0;
+        }
+        if (hit) {
+          matches[i].push_back(GrepMatch{insn.GetAddress().GetLoadAddress(target), text});
+        }
+      }
+    });
+    uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::steady_clock::now() - started).count();
+
+    std::stringstream ss;
+    size_t total = 0;
+    size_t functions = 0;
+    for (size_t i = 0; i < bodies.size(); ++i) {
+      functions += !matches[i].empty();
+      for (const auto &match : matches[i]) {
+        if (total++ >= limit) {
+          continue;
+        }
+        char addr_str[32];
+        snprintf(addr_str, sizeof(addr_str), "0x%016" PRIX64, match.addr);
+        ss << addr_str << "  " << bodies[i].name << "+0x" << std::hex
+           << match.addr - bodies[i].addr << std::dec;
+        if (!match.text.empty()) {
+          ss << "  " << match.text;
+        }
+        ss << "\n";
+      }
+    }
+    ss << std::fixed << std::setprecision(1);
+    ss << total << " match(es) in " << functions << " function(s)";
+    if (total > limit) {
+      ss << ", first " << limit << " shown";
+    }
+    ss << "; searched " << bodies.size() << " functions (" << scanned / 1024 << " KiB) in "
+       << us / 1000.0 << " ms.";
+    result.AppendMessage(ss.str().c_str());
+    result.SetStatus(eReturnStatusSuccessFinishResult);
+    return true;
+  }
+};
+
+// Helper: bring the xref index up to date by decoding every function marked
+// dirty since the last refresh. The first call enables tracking and indexes
+// all registered code. Runs on the command thread.
+static size_t RefreshXrefIndex(SBTarget &target, SBProcess &process) {
+  std::unordered_set<uint64_t> dirty;
+  {
+    std::lock_guard<std::mutex> lock(g_xref_mutex);
+    if (!g_xref_enabled.exchange(true)) {
+      std::lock_guard<std::mutex> jit_lock(g_jit_mutex);
+      for (const auto &pair : g_jit_sizes) {
+        g_xref_dirty.insert(pair.first);
+      }
+    }
+    dirty.swap(g_xref_dirty);
+  }
+  if (dirty.empty()) {
+    return 0;
+  }
+
+  uint64_t code_min = 0;
+  {
+    std::lock_guard<std::mutex> lock(g_jit_mutex);
+    if (!g_jit_sizes.empty()) {
+      code_min = g_jit_sizes.begin()->first;
+    }
+  }
+  // Executable regions seen so far: (base, end, executable)
+  std::vector<std::tuple<uint64_t, uint64_t, bool>> regions;
+  auto executable = [&](uint64_t addr) {
+    for (const auto &region : regions) {
+      if (addr >= std::get<0>(region) && addr < std::get<1>(region)) {
+        return std::get<2>(region);
+      }
+    }
+    SBMemoryRegionInfo info;
+    if (process.GetMemoryRegionInfo(addr, info).Fail()) {
+      return false;
+    }
+    regions.emplace_back(info.GetRegionBase(), info.GetRegionEnd(),
+                         info.IsMapped() && info.IsExecutable());
+    return std::get<2>(regions.back());
+  };
+
+  std::vector<JITCodeBody> bodies = FetchJITCode(process, "", &dirty);
+  for (const auto &body : bodies) {
+    std::vector<XrefSite> sites;
+    for (const auto &transfer : DecodeControlTransfers(target, body.addr, body.bytes)) {
+      if (transfer.has_target &&
+          (transfer.dest < body.addr || transfer.dest >= body.addr + body.size)) {
+        sites.push_back(XrefSite{body.addr, transfer.addr, transfer.dest, transfer.is_call});
+      }
+    }
+    std::vector<uint64_t> callees(sites.size(), 0);
+    {
+      std::lock_guard<std::mutex> lock(g_jit_mutex);
+      for (size_t i = 0; i < sites.size(); ++i) {
+        LookupJITFunctionLocked(sites[i].to, callees[i]);
+      }
+    }
+    // Only targets in mapped executable memory at or above the registry can
+    // still be registered later
+    std::vector<bool> parkable(sites.size(), false);
+    for (size_t i = 0; i < sites.size(); ++i) {
+      parkable[i] = !callees[i] && sites[i].to >= code_min && executable(sites[i].to);
+    }
+    InstallXrefs(body.addr, sites, callees, parkable);
+  }
+  return bodies.size();
+}
+
+// Who calls or jumps to a JIT function, from the xref index
+class DartJITXrefsCommand : public SBCommandPluginInterface {
+public:
+  bool DoExecute(SBDebugger debugger, char **command,
+                 SBCommandReturnObject &result) override {
+    bool callees = false;
+    bool rebuild = false;
+    std::string dot_path;
+    std::string query;
+    if (command && command[0] && std::string(command[0]) == "disable") {
+      std::lock_guard<std::mutex> lock(g_xref_mutex);
+      g_xref_enabled = false;
+      g_xref_dirty.clear();
+      g_xref_out.clear();
+      g_xref_in.clear();
+      g_xref_unresolved.clear();
+      result.AppendMessage("Xref tracking disabled and index cleared.");
+      result.SetStatus(eReturnStatusSuccessFinishNoResult);
+      return true;
+    }
+    for (char **arg = command; arg && *arg; ++arg) {
+      std::string opt = *arg;
+      if (opt == "--callees") {
+        callees = true;
+      } else if (opt == "--rebuild") {
+        rebuild = true;
+      } else if (opt == "--dot" && arg[1]) {
+        dot_path = *++arg;
+      } else if (opt.compare(0, 2, "--") != 0 && query.empty()) {
+        query = opt;
+      } else {
+        query.clear();
+        rebuild = false;
+        dot_path.clear();
+        break;
+      }
+    }
+    if (query.empty() && !rebuild && dot_path.empty()) {
+      result.AppendMessage(
+          "Usage: dart-jit xrefs <function|address> [--callees]\n"
+          "       dart-jit xrefs --rebuild | --dot <file.dot> | disable\n"
+          "Lists the direct calls and jumps into a function (or, with --callees,\n"
+          "out of it). The first use indexes all registered code; afterwards only\n"
+          "code registered since the previous use is decoded. --rebuild re-decodes\n"
+          "everything, --dot exports the call graph, disable stops tracking.");
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    SBTarget target = debugger.GetSelectedTarget();
+    SBProcess process = target.GetProcess();
+    if (!target.IsValid() || !process.IsValid()) {
+      result.AppendMessage("No valid process. Please run the program first.");
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    std::stringstream ss;
+    if (rebuild) {
+      std::lock_guard<std::mutex> lock(g_xref_mutex);
+      if (g_xref_enabled) {
+        std::lock_guard<std::mutex> jit_lock(g_jit_mutex);
+        for (const auto &pair : g_jit_sizes) {
+          g_xref_dirty.insert(pair.first);
+        }
+      }
+    }
+    size_t decoded = RefreshXrefIndex(target, process);
+    if (decoded) {
+      ss << "Indexed " << decoded << " function(s).\n";
+    }
+
+    if (!dot_path.empty() && !WriteDot(dot_path, ss)) {
+      result.AppendMessage(ss.str().c_str());
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    if (!query.empty()) {
+      uint64_t func = 0;
+      uint64_t size = 0;
+      std::string name;
+      bool found = false;
+      if (query.compare(0, 2, "0x") == 0) {
+        std::lock_guard<std::mutex> lock(g_jit_mutex);
+        found = LookupJITFunctionLocked(strtoull(query.c_str(), nullptr, 16), func);
+        if (found) {
+          name = g_jit_functions[func];
+        }
+      } else {
+        found = FindJITFunctionByName(query, func, size, name);
+      }
+      if (!found) {
+        ss << "Function '" << query << "' not found in JIT-compiled code.";
+        result.AppendMessage(ss.str().c_str());
+        result.SetStatus(eReturnStatusFailed);
+        return false;
+      }
+
+      std::vector<XrefSite> sites;
+      {
+        std::lock_guard<std::mutex> lock(g_xref_mutex);
+        auto &index = callees ? g_xref_out : g_xref_in;
+        auto it = index.find(func);
+        if (it != index.end()) {
+          sites = it->second;
+        }
+      }
+      std::sort(sites.begin(), sites.end(), [](const XrefSite &a, const XrefSite &b) {
+        return a.site < b.site;
+      });
+
+      ss << (callees ? "Direct branches out of '" : "Direct branches into '") << name
+         << "' (0x" << std::hex << func << std::dec << "):\n";
+      for (const auto &site : sites) {
+        ss << "  " << (site.is_call ? "call " : "jump ") << SymbolizeJITAddress(site.site);
+        if (callees) {
+          ss << " -> " << SymbolizeJITAddress(site.to);
+        }
+        ss << "\n";
+      }
+      ss << sites.size() << " site(s).";
+    }
+
+    result.AppendMessage(ss.str().c_str());
+    result.SetStatus(eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+private:
+  // Static call graph in Graphviz format, one edge per caller/callee pair
+  bool WriteDot(const std::string &path, std::stringstream &ss) {
+    std::map<std::pair<uint64_t, uint64_t>, uint64_t> edges;
+    {
+      std::lock_guard<std::mutex> lock(g_xref_mutex);
+      for (const auto &pair : g_xref_in) {
+        for (const auto &site : pair.second) {
+          edges[std::make_pair(site.from, pair.first)]++;
+        }
+      }
+    }
+    std::unordered_set<uint64_t> nodes;
+    for (const auto &edge : edges) {
+      nodes.insert(edge.first.first);
+      nodes.insert(edge.first.second);
+    }
+
+    std::ofstream out(path);
+    if (!out) {
+      ss << "Cannot write " << path;
+      return false;
+    }
+    out << "digraph dart_jit_calls {\n  node [shape=ellipse, fontsize=10];\n";
+    {
+      std::lock_guard<std::mutex> lock(g_jit_mutex);
+      for (uint64_t node : nodes) {
+        out << "  n" << std::hex << node << std::dec << " [label=\""
+            << JSONEscape(g_jit_functions[node]) << "\""
+            << (IsStubEntryLocked(node) ? ", shape=box" : "") << "];\n";
+      }
+    }
+    for (const auto &edge : edges) {
+      out << "  n" << std::hex << edge.first.first << " -> n" << edge.first.second << std::dec;
+      if (edge.second > 1) {
+        out << " [label=\"" << edge.second << "\"]";
+      }
+      out << ";\n";
+    }
+    out << "}\n";
+    ss << "Wrote " << nodes.size() << " functions and " << edges.size() << " edges to " << path
+       << ".\n";
+    return true;
+  }
+};
+
+// Helper: what to do about an expensive breakpoint, or "" if nothing
+static std::string SuggestBreakpointFix(const std::string &owner, uint64_t hits,
+                                        bool has_condition, bool auto_continue,
+                                        double avg_callback_us) {
+  const uint64_t kHot = 1000;
+  const uint64_t kFrequentStop = 100;
+  static const std::pair<const char *, const char *> kFeatureOff[] = {
+      {"__lldb_internal_dart_allocprof", "dart-jit allocprof stop"},
+      {"__lldb_internal_dart_deopt", "dart-jit deopts disable"},
+      {"__lldb_internal_dart_gc", "dart-jit gc disable"},
+      {"__lldb_internal_dart_compile", "dart-jit compile-times disable"},
+  };
+  if (has_condition && hits >= kFrequentStop) {
+    return "condition is evaluated on every hit; use an ignore count or an unconditional "
+           "auto-continue (counting) breakpoint";
+  }
+  if (!auto_continue && hits >= kFrequentStop) {
+    return "stops on every hit; count instead with 'breakpoint modify --auto-continue true'";
+  }
+  if (owner == "__lldb_internal_jit_monitor" && hits >= kHot) {
+    return "registration hook is hot; disable features that add work per registration, "
+           "or disable it after warm-up (later code is then not registered)";
+  }
+  for (const auto &feature : kFeatureOff) {
+    if (owner == feature.first && hits >= kHot) {
+      return std::string("disable when not needed: ") + feature.second;
+    }
+  }
+  if (avg_callback_us > 1000.0) {
+    return "slow callback (over 1 ms per hit)";
+  }
+  return "";
+}
+
+// Rank breakpoints by the overhead they impose on the session
+class DartJITBpCostCommand : public SBCommandPluginInterface {
+public:
+  bool DoExecute(SBDebugger debugger, char **command,
+                 SBCommandReturnObject &result) override {
+    size_t top = 20;
+    double round_trip_us = 50.0;
+    bool all = false;
+    bool by_callback = false;
+    for (char **arg = command; arg && *arg; ++arg) {
+      std::string opt = *arg;
+      if (opt == "--top" && arg[1]) {
+        top = strtoull(*++arg, nullptr, 0);
+      } else if (opt == "--sort" && arg[1]) {
+        by_callback = std::string(*++arg) == "callback";
+      } else if (opt == "--round-trip-us" && arg[1]) {
+        round_trip_us = strtod(*++arg, nullptr);
+      } else if (opt == "--all") {
+        all = true;
+      } else if (opt == "--reset") {
+        std::lock_guard<std::mutex> lock(g_bpcost_mutex);
+        g_bp_costs.clear();
+        g_retired_bp_costs.clear();
+        result.AppendMessage("Breakpoint cost counters cleared.");
+        result.SetStatus(eReturnStatusSuccessFinishNoResult);
+        return true;
+      } else {
+        result.AppendMessage(
+            "Usage: dart-jit bpcost [--top N] [--round-trip-us N] [--all]\n"
+            "                       [--sort estimated|callback] | --reset\n"
+            "Ranks the plugin's breakpoints (and with --all every breakpoint) by\n"
+            "estimated overhead: measured callback time plus an assumed, not\n"
+            "measured, stop/resume round trip per hit (default 50 us), and\n"
+            "suggests how to make them cheaper. --sort callback ranks by the\n"
+            "measured callback time alone.");
+        result.SetStatus(eReturnStatusFailed);
+        return false;
+      }
+    }
+
+    SBTarget target = debugger.GetSelectedTarget();
+    if (!target.IsValid()) {
+      result.AppendMessage("No valid target selected.");
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    struct Row {
+      std::string id;
+      std::string owner;
+      uint64_t hits = 0;
+      uint64_t auto_continues = 0;
+      bool has_condition = false;
+      bool auto_continue = false;
+      uint64_t callback_ns = 0;
+      double total_ms = 0;
+    };
+    std::unordered_map<break_id_t, std::string> owned;
+    std::unordered_map<break_id_t, BreakpointCost> costs;
+    std::map<std::string, BreakpointCost> retired;
+    {
+      std::lock_guard<std::mutex> lock(g_bpcost_mutex);
+      owned = g_owned_bps;
+      costs = g_bp_costs;
+      retired = g_retired_bp_costs;
+    }
+
+    std::vector<Row> rows;
+    for (uint32_t i = 0; i < target.GetNumBreakpoints(); ++i) {
+      SBBreakpoint bp = target.GetBreakpointAtIndex(i);
+      break_id_t id = bp.GetID();
+      auto owner = owned.find(id);
+      auto cost = costs.find(id);
+      if (!all && owner == owned.end() && cost == costs.end()) {
+        continue;
+      }
+      Row row;
+      row.id = std::to_string(id);
+      row.owner = owner != owned.end() ? owner->second
+                                       : (cost != costs.end() ? "(plugin callback)" : "(user)");
+      row.has_condition = bp.GetCondition() && *bp.GetCondition();
+      row.auto_continue = bp.GetAutoContinue();
+      if (cost != costs.end()) {
+        row.hits = cost->second.hits;
+        row.auto_continues = cost->second.auto_continues;
+        row.callback_ns = cost->second.callback_ns;
+        costs.erase(cost);
+      } else {
+        row.hits = bp.GetHitCount();
+        row.auto_continues = row.auto_continue ? row.hits : 0;
+      }
+      rows.push_back(row);
+    }
+
+    // One-shot breakpoints (e.g. GC exits) and others deleted since they
+    // were hit are gone; fold them per owner
+    for (const auto &pair : costs) {
+      auto owner = owned.find(pair.first);
+      std::string name = owner != owned.end() ? owner->second : "(plugin callback)";
+      BreakpointCost &cost = retired[name];
+      cost.hits += pair.second.hits;
+      cost.auto_continues += pair.second.auto_continues;
+      cost.callback_ns += pair.second.callback_ns;
+    }
+    std::map<std::string, Row> gone;
+    for (const auto &pair : retired) {
+      const std::string &name = pair.first;
+      Row &row = gone[name];
+      row.id = "-";
+      row.owner = name + " (deleted)";
+      row.hits += pair.second.hits;
+      row.auto_continues += pair.second.auto_continues;
+      row.callback_ns += pair.second.callback_ns;
+      row.auto_continue = true;
+    }
+    for (const auto &pair : gone) {
+      rows.push_back(pair.second);
+    }
+
+    double total_ms = 0;
+    for (auto &row : rows) {
+      row.total_ms = row.callback_ns / 1e6 + row.hits * round_trip_us / 1000.0;
+      total_ms += row.total_ms;
+    }
+    std::sort(rows.begin(), rows.end(), [by_callback](const Row &a, const Row &b) {
+      return by_callback ? a.callback_ns > b.callback_ns : a.total_ms > b.total_ms;
+    });
+    if (rows.empty()) {
+      result.AppendMessage("No plugin breakpoints have been created yet.");
+      result.SetStatus(eReturnStatusSuccessFinishResult);
+      return true;
+    }
+
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1);
+    ss << "Breakpoint overhead, sorted by " << (by_callback ? "measured callback" : "estimated")
+       << " time\n";
+    ss << "Callback ms is measured. Est. ms adds an ASSUMED stop/resume round trip of "
+       << round_trip_us << " us per hit (--round-trip-us); it is not measured.\n";
+    ss << "   ID       Hits  AutoCont Cond  Callback ms  Avg us    Est. ms  Owner\n";
+    ss << "----- ---------- --------- ---- ------------ ------- ----------  ------------------------------\n";
+    std::vector<std::pair<std::string, std::string>> suggestions;
+    for (size_t i = 0; i < rows.size() && i < top; ++i) {
+      const Row &row = rows[i];
+      double avg_us = row.hits ? row.callback_ns / 1e3 / row.hits : 0.0;
+      ss << std::setw(5) << row.id << " " << std::setw(10) << row.hits << " " << std::setw(9)
+         << row.auto_continues << " " << std::setw(4) << (row.has_condition ? "yes" : "")
+         << " " << std::setw(12) << row.callback_ns / 1e6 << " " << std::setw(7) << avg_us
+         << " " << std::setw(10) << row.total_ms << "  " << row.owner << "\n";
+      std::string fix = SuggestBreakpointFix(row.owner, row.hits, row.has_condition,
+                                             row.auto_continue, avg_us);
+      if (!fix.empty()) {
+        suggestions.emplace_back(row.id, fix);
+      }
+    }
+    ss << "Estimated total (assuming " << round_trip_us << " us per hit): " << total_ms << " ms\n";
+    if (!suggestions.empty()) {
+      ss << "\nSuggestions:\n";
+      for (const auto &suggestion : suggestions) {
+        ss << "  [" << suggestion.first << "] " << suggestion.second << "\n";
+      }
+    }
+
+    result.AppendMessage(ss.str().c_str());
+    result.SetStatus(eReturnStatusSuccessFinishResult);
+    return true;
+  }
+};
+
+// Helper: 4 KiB pages and 2 MiB regions touched by a set of code ranges
+static void CountCodePages(const std::vector<std::pair<uint64_t, uint64_t>> &ranges,
+                           size_t &pages, size_t &regions) {
+  const uint64_t kPage = 4096;
+  const uint64_t kRegion = 2 * 1024 * 1024;
+  std::unordered_set<uint64_t> page_set;
+  std::unordered_set<uint64_t> region_set;
+  for (const auto &range : ranges) {
+    if (range.second == 0) {
+      continue;
+    }
+    uint64_t last = range.first + range.second - 1;
+    for (uint64_t page = range.first / kPage; page <= last / kPage; ++page) {
+      page_set.insert(page);
+    }
+    for (uint64_t region = range.first / kRegion; region <= last / kRegion; ++region) {
+      region_set.insert(region);
+    }
+  }
+  pages = page_set.size();
+  regions = region_set.size();
+}
+
+// Helper: Pettis-Hansen style ordering. Chains start as single functions and
+// are merged along the heaviest edges first, oriented so the two endpoints
+// end up as close as possible; chains are then emitted hottest first.
+static std::vector<uint64_t> PettisHansenOrder(
+    const std::vector<uint64_t> &funcs,
+    const std::vector<std::pair<std::pair<uint64_t, uint64_t>, uint64_t>> &edges,
+    const std::unordered_map<uint64_t, uint64_t> &heat) {
+  std::unordered_map<uint64_t, size_t> chain_of;
+  std::vector<std::deque<uint64_t>> chains;
+  for (uint64_t func : funcs) {
+    chain_of[func] = chains.size();
+    chains.push_back(std::deque<uint64_t>{func});
+  }
+
+  auto sorted = edges;
+  std::sort(sorted.begin(), sorted.end(),
+            [](const auto &a, const auto &b) { return a.second > b.second; });
+  for (const auto &edge : sorted) {
+    auto ca = chain_of.find(edge.first.first);
+    auto cb = chain_of.find(edge.first.second);
+    if (ca == chain_of.end() || cb == chain_of.end() || ca->second == cb->second) {
+      continue;
+    }
+    std::deque<uint64_t> &a = chains[ca->second];
+    std::deque<uint64_t> &b = chains[cb->second];
+    uint64_t from = edge.first.first;
+    uint64_t to = edge.first.second;
+    // Put from at the tail of a and to at the head of b where possible
+    if (a.front() == from && a.back() != from) {
+      std::reverse(a.begin(), a.end());
+    }
+    if (b.back() == to && b.front() != to) {
+      std::reverse(b.begin(), b.end());
+    }
+    size_t target = ca->second;
+    for (uint64_t func : b) {
+      chain_of[func] = target;
+    }
+    a.insert(a.end(), b.begin(), b.end());
+    b.clear();
+  }
+
+  std::vector<std::pair<uint64_t, size_t>> ranked;
+  for (size_t i = 0; i < chains.size(); ++i) {
+    if (chains[i].empty()) {
+      continue;
+    }
+    uint64_t total = 0;
+    for (uint64_t func : chains[i]) {
+      auto it = heat.find(func);
+      total += it != heat.end() ? it->second : 0;
+    }
+    ranked.emplace_back(total, i);
+  }
+  std::sort(ranked.begin(), ranked.end(),
+            [](const auto &a, const auto &b) { return a.first > b.first; });
+  std::vector<uint64_t> order;
+  for (const auto &chain : ranked) {
+    order.insert(order.end(), chains[chain.second].begin(), chains[chain.second].end());
+  }
+  return order;
+}
+
+// Code-layout locality of the hot JIT working set
+class DartJITLocalityCommand : public SBCommandPluginInterface {
+public:
+  bool DoExecute(SBDebugger debugger, char **command,
+                 SBCommandReturnObject &result) override {
+    std::string profile_path;
+    std::string output_path;
+    size_t top = 15;
+    double hot_fraction = 0.9;
+    for (char **arg = command; arg && *arg; ++arg) {
+      std::string opt = *arg;
+      if (opt == "--profile" && arg[1]) {
+        profile_path = *++arg;
+      } else if (opt == "--output" && arg[1]) {
+        output_path = *++arg;
+      } else if (opt == "--top" && arg[1]) {
+        top = strtoull(*++arg, nullptr, 0);
+      } else if (opt == "--hot" && arg[1]) {
+        hot_fraction = std::min(1.0, std::max(0.01, strtod(*++arg, nullptr)));
+      } else {
+        result.AppendMessage(
+            "Usage: dart-jit locality [--profile <file.folded>] [--hot F] [--top N]\n"
+            "                         [--output <order.txt>]\n"
+            "Measures how scattered the hot JIT code is: caller->callee distances,\n"
+            "4 KiB pages and 2 MiB regions spanned by the functions holding F\n"
+            "(default 0.9) of the samples, and a density score, then proposes a\n"
+            "Pettis-Hansen ordering. Call counts come from recorded profile stacks\n"
+            "(dart-jit profile, or --profile) or else from xrefs weighted by samples.");
+        result.SetStatus(eReturnStatusFailed);
+        return false;
+      }
+    }
+
+    std::unordered_map<uint64_t, uint64_t> heat;
+    std::unordered_map<std::string, uint64_t> stacks;
+    if (!profile_path.empty()) {
+      if (!ReadFoldedProfile(profile_path, stacks)) {
+        std::string msg = "Cannot read profile " + profile_path;
+        result.AppendMessage(msg.c_str());
+        result.SetStatus(eReturnStatusFailed);
+        return false;
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(g_sample_mutex);
+      heat = g_hot_samples;
+      if (profile_path.empty()) {
+        stacks = g_profile_stacks;
+      }
+    }
+
+    // Resolve profile frames by name, preferring the hottest code version
+    std::map<uint64_t, uint64_t> sizes;
+    std::unordered_map<uint64_t, std::string> names;
+    std::unordered_map<std::string, uint64_t> by_name;
+    {
+      std::lock_guard<std::mutex> lock(g_jit_mutex);
+      sizes.insert(g_jit_sizes.begin(), g_jit_sizes.end());
+      for (const auto &pair : g_jit_functions) {
+        names[pair.first] = pair.second;
+        auto it = by_name.find(pair.second);
+        if (it == by_name.end() || heat[pair.first] > heat[it->second]) {
+          by_name[pair.second] = pair.first;
+        }
+      }
+    }
+
+    std::map<std::pair<uint64_t, uint64_t>, uint64_t> pair_counts;
+    const char *source = "profile stacks";
+    for (const auto &stack : stacks) {
+      std::vector<std::string> frames = SplitFoldedStack(stack.first);
+      for (size_t i = 0; i + 1 < frames.size(); ++i) {
+        auto caller = by_name.find(frames[i]);
+        auto callee = by_name.find(frames[i + 1]);
+        if (caller != by_name.end() && callee != by_name.end() && caller->second != callee->second) {
+          pair_counts[std::make_pair(caller->second, callee->second)] += stack.second;
+        }
+      }
+      if (!profile_path.empty() && !frames.empty()) {
+        auto leaf = by_name.find(frames.back());
+        if (leaf != by_name.end()) {
+          heat[leaf->second] += stack.second;
+        }
+      }
+    }
+    if (pair_counts.empty()) {
+      source = "xrefs weighted by callee samples";
+      SBTarget target = debugger.GetSelectedTarget();
+      SBProcess process = target.GetProcess();
+      if (g_xref_enabled && target.IsValid() && process.IsValid()) {
+        RefreshXrefIndex(target, process);
+      }
+      std::lock_guard<std::mutex> lock(g_xref_mutex);
+      for (const auto &pair : g_xref_in) {
+        auto callee_heat = heat.find(pair.first);
+        if (callee_heat == heat.end()) {
+          continue;
+        }
+        for (const auto &site : pair.second) {
+          if (site.is_call && heat.count(site.from)) {
+            pair_counts[std::make_pair(site.from, pair.first)] = callee_heat->second;
+          }
+        }
+      }
+    }
+
+    // Hot working set: hottest functions covering hot_fraction of samples
+    std::vector<std::pair<uint64_t, uint64_t>> hottest;  // (samples, addr)
+    uint64_t total_samples = 0;
+    for (const auto &pair : heat) {
+      if (pair.second && sizes.count(pair.first)) {
+        hottest.emplace_back(pair.second, pair.first);
+        total_samples += pair.second;
+      }
+    }
+    if (total_samples == 0) {
+      result.AppendMessage(
+          "No samples of JIT code yet. Samples are taken while plugin breakpoints\n"
+          "stop the process; let the program run longer or pass --profile.");
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+    std::sort(hottest.begin(), hottest.end(), std::greater<std::pair<uint64_t, uint64_t>>());
+    std::vector<uint64_t> hot_set;
+    std::vector<std::pair<uint64_t, uint64_t>> hot_ranges;
+    uint64_t covered = 0;
+    uint64_t hot_bytes = 0;
+    for (const auto &entry : hottest) {
+      if (covered >= hot_fraction * total_samples) {
+        break;
+      }
+      covered += entry.first;
+      hot_set.push_back(entry.second);
+      hot_ranges.emplace_back(entry.second, sizes[entry.second]);
+      hot_bytes += sizes[entry.second];
+    }
+
+    const uint64_t kPage = 4096;
+    const uint64_t kRegion = 2 * 1024 * 1024;
+    const uint64_t kAlignment = 16;
+    size_t pages = 0;
+    size_t regions = 0;
+    CountCodePages(hot_ranges, pages, regions);
+    uint64_t min_pages = (hot_bytes + kPage - 1) / kPage;
+    uint64_t min_regions = (hot_bytes + kRegion - 1) / kRegion;
+
+    // Pairs among the hot set, heaviest first
+    std::unordered_set<uint64_t> hot_lookup(hot_set.begin(), hot_set.end());
+    std::vector<std::pair<std::pair<uint64_t, uint64_t>, uint64_t>> edges;
+    for (const auto &pair : pair_counts) {
+      if (hot_lookup.count(pair.first.first) && hot_lookup.count(pair.first.second)) {
+        edges.emplace_back(pair.first, pair.second);
+      }
+    }
+    std::sort(edges.begin(), edges.end(),
+              [](const auto &a, const auto &b) { return a.second > b.second; });
+
+    // Proposed layout: hot functions packed back to back in the new order
+    std::vector<uint64_t> order = PettisHansenOrder(hot_set, edges, heat);
+    std::unordered_map<uint64_t, uint64_t> new_addr;
+    std::vector<std::pair<uint64_t, uint64_t>> new_ranges;
+    uint64_t cursor = 0;
+    for (uint64_t func : order) {
+      new_addr[func] = cursor;
+      new_ranges.emplace_back(cursor, sizes[func]);
+      cursor += (sizes[func] + kAlignment - 1) / kAlignment * kAlignment;
+    }
+    size_t new_pages = 0;
+    size_t new_regions = 0;
+    CountCodePages(new_ranges, new_pages, new_regions);
+
+    auto distance = [](uint64_t a, uint64_t b) { return a > b ? a - b : b - a; };
+    double weighted = 0;
+    double new_weighted = 0;
+    uint64_t weight = 0;
+    for (const auto &edge : edges) {
+      weighted += static_cast<double>(distance(edge.first.first, edge.first.second)) * edge.second;
+      new_weighted += static_cast<double>(distance(new_addr[edge.first.first],
+                                                   new_addr[edge.first.second])) * edge.second;
+      weight += edge.second;
+    }
+
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(2);
+    ss << "Hot working set: " << hot_set.size() << " functions, " << hot_bytes << " bytes, "
+       << 100.0 * covered / total_samples << "% of " << total_samples << " samples\n";
+    ss << "  4 KiB pages:   " << pages << " touched (minimum " << min_pages << ", proposed "
+       << new_pages << ")\n";
+    ss << "  2 MiB regions: " << regions << " touched (minimum " << min_regions << ", proposed "
+       << new_regions << ")\n";
+    ss << "  Density:       " << static_cast<double>(hot_bytes) / (pages * kPage)
+       << " (hot bytes per touched page byte; proposed "
+       << static_cast<double>(hot_bytes) / (std::max<size_t>(1, new_pages) * kPage) << ")\n";
+    if (weight) {
+      ss << "  Mean caller->callee distance: " << weighted / weight / 1024 << " KiB (proposed "
+         << new_weighted / weight / 1024 << " KiB)\n";
+    }
+
+    ss << "\nHottest caller->callee pairs (from " << source << "):\n";
+    ss << "     Count      Distance  Page  2MB  Caller -> Callee\n";
+    ss << "---------- ------------- ----- ----  ------------------------------\n";
+    for (size_t i = 0; i < edges.size() && i < top; ++i) {
+      uint64_t from = edges[i].first.first;
+      uint64_t to = edges[i].first.second;
+      ss << std::setw(10) << edges[i].second << " " << std::setw(13) << distance(from, to) << " "
+         << std::setw(5) << (from / kPage == to / kPage ? "same" : "")
+         << std::setw(5) << (from / kRegion == to / kRegion ? "same" : "") << "  "
+         << names[from] << " -> " << names[to] << "\n";
+    }
+    if (edges.empty()) {
+      ss << "(no call pairs among hot functions; record a profile or run dart-jit xrefs --rebuild)\n";
+    }
+
+    ss << "\nSuggested order (Pettis-Hansen):\n";
+    for (size_t i = 0; i < order.size() && i < top; ++i) {
+      ss << std::setw(4) << i + 1 << ". " << names[order[i]] << " (" << heat[order[i]]
+         << " samples, " << sizes[order[i]] << " bytes)\n";
+    }
+    if (!output_path.empty()) {
+      std::ofstream out(output_path);
+      if (!out) {
+        ss << "Cannot write " << output_path << "\n";
+      } else {
+        for (uint64_t func : order) {
+          out << names[func] << "\n";
+        }
+        ss << "Wrote the full order (" << order.size() << " functions) to " << output_path << "\n";
+      }
+    }
+
+    result.AppendMessage(ss.str().c_str());
+    result.SetStatus(eReturnStatusSuccessFinishResult);
+    return true;
+  }
+};
+
+// Per-function summary of one run, as written by dart-jit snapshot save
+struct SnapshotEntry {
+  uint64_t first_us;   // first registration, relative to plugin load
+  uint64_t compiles;   // registrations of the name during the run
+  std::string tier;    // tier attribute of the last registration, if any
+};
+
+static const char kSnapshotHeader[] = "# dart-jit snapshot v1";
+
+// Helper: read a snapshot file into name -> entry
+static bool ReadRegistrySnapshot(const std::string &path,
+                                 std::unordered_map<std::string, SnapshotEntry> &entries) {
+  std::ifstream in(path);
+  std::string line;
+  if (!in || !std::getline(in, line) || line != kSnapshotHeader) {
+    return false;
+  }
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream fields(line);
+    std::string first_us;
+    std::string compiles;
+    std::string tier;
+    std::string name;
+    if (!std::getline(fields, first_us, '\t') || !std::getline(fields, compiles, '\t') ||
+        !std::getline(fields, tier, '\t') || !std::getline(fields, name)) {
+      continue;
+    }
+    entries[name] = SnapshotEntry{strtoull(first_us.c_str(), nullptr, 10),
+                                  strtoull(compiles.c_str(), nullptr, 10),
+                                  tier == "-" ? "" : tier};
+  }
+  return true;
+}
+
+// Save a compact per-function summary of this run's registrations
+class DartJITSnapshotCommand : public SBCommandPluginInterface {
+public:
+  bool DoExecute(SBDebugger debugger, char **command,
+                 SBCommandReturnObject &result) override {
+    if (!command || !command[0] || std::string(command[0]) != "save" || !command[1]) {
+      result.AppendMessage(
+          "Usage: dart-jit snapshot save <file>\n"
+          "Writes when each function was first registered in this run, how often\n"
+          "it was compiled and its final tier, for dart-jit warmup-profile.");
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    // First registration time and last code address per name
+    std::unordered_map<std::string, std::pair<uint64_t, uint64_t>> seen;
+    {
+      std::lock_guard<std::mutex> lock(g_timeline_mutex);
+      for (const auto &event : g_timeline) {
+        if (event.category != "jit") {
+          continue;
+        }
+        auto it = seen.find(event.name);
+        if (it == seen.end()) {
+          seen.emplace(event.name, std::make_pair(event.ts_us, event.addr));
+        } else {
+          it->second.first = std::min(it->second.first, event.ts_us);
+          it->second.second = event.addr;
+        }
+      }
+    }
+
+    std::ofstream out(command[1]);
+    if (!out) {
+      std::string msg = std::string("Cannot write ") + command[1];
+      result.AppendMessage(msg.c_str());
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+    out << kSnapshotHeader << "\n";
+    {
+      std::lock_guard<std::mutex> lock(g_jit_mutex);
+      for (const auto &pair : seen) {
+        std::string tier;
+        if (!FindJITAttrLocked(pair.second.second, "tier", tier) || tier.empty()) {
+          tier = "-";
+        }
+        out << pair.second.first << "\t" << g_jit_name_versions[pair.first] << "\t" << tier
+            << "\t" << pair.first << "\n";
+      }
+    }
+
+    std::stringstream ss;
+    ss << "Saved " << seen.size() << " function(s) to " << command[1] << ".";
+    result.AppendMessage(ss.str().c_str());
+    result.SetStatus(eReturnStatusSuccessFinishResult);
+    return true;
+  }
+};
+
+// Merge snapshots of many runs into a ranked warm-up list
+class DartJITWarmupProfileCommand : public SBCommandPluginInterface {
+public:
+  bool DoExecute(SBDebugger debugger, char **command,
+                 SBCommandReturnObject &result) override {
+    std::vector<std::string> paths;
+    std::string output_path;
+    size_t top = 30;
+    double min_fraction = 0.0;
+    for (char **arg = command; arg && *arg; ++arg) {
+      std::string opt = *arg;
+      if (opt == "--output" && arg[1]) {
+        output_path = *++arg;
+      } else if (opt == "--top" && arg[1]) {
+        top = strtoull(*++arg, nullptr, 0);
+      } else if (opt == "--min-runs" && arg[1]) {
+        min_fraction = strtod(*++arg, nullptr);
+      } else if (opt.compare(0, 2, "--") != 0) {
+        paths.push_back(opt);
+      } else {
+        paths.clear();
+        break;
+      }
+    }
+    if (paths.empty()) {
+      result.AppendMessage(
+          "Usage: dart-jit warmup-profile <snapshot...> [--min-runs F] [--top N]\n"
+          "                               [--output <file>]\n"
+          "Merges dart-jit snapshot files from several runs. For every function:\n"
+          "the median first-compile time, the fraction of runs that compiled it,\n"
+          "compiles per run and the most common final tier. Functions compiled\n"
+          "in at least F of the runs are ranked by how often and how early.");
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    struct Merged {
+      std::vector<uint64_t> first_us;
+      uint64_t compiles = 0;
+      std::map<std::string, uint32_t> tiers;
+    };
+    std::unordered_map<std::string, Merged> merged;
+    for (const auto &path : paths) {
+      std::unordered_map<std::string, SnapshotEntry> entries;
+      if (!ReadRegistrySnapshot(path, entries)) {
+        std::string msg = "Not a dart-jit snapshot: " + path;
+        result.AppendMessage(msg.c_str());
+        result.SetStatus(eReturnStatusFailed);
+        return false;
+      }
+      for (const auto &pair : entries) {
+        Merged &m = merged[pair.first];
+        m.first_us.push_back(pair.second.first_us);
+        m.compiles += pair.second.compiles;
+        if (!pair.second.tier.empty()) {
+          m.tiers[pair.second.tier]++;
+        }
+      }
+    }
+
+    struct Row {
+      std::string name;
+      double fraction;
+      uint64_t median_us;
+      double compiles_per_run;
+      std::string tier;
+    };
+    std::vector<Row> rows;
+    for (auto &pair : merged) {
+      Merged &m = pair.second;
+      double fraction = static_cast<double>(m.first_us.size()) / paths.size();
+      if (fraction < min_fraction) {
+        continue;
+      }
+      std::sort(m.first_us.begin(), m.first_us.end());
+      std::string tier = "-";
+      uint32_t best = 0;
+      for (const auto &t : m.tiers) {
+        if (t.second > best) {
+          best = t.second;
+          tier = t.first;
+        }
+      }
+      rows.push_back(Row{pair.first, fraction, m.first_us[m.first_us.size() / 2],
+                         static_cast<double>(m.compiles) / m.first_us.size(), tier});
+    }
+    std::sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) {
+      return a.fraction != b.fraction ? a.fraction > b.fraction : a.median_us < b.median_us;
+    });
+
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(2);
+    ss << "Warm-up profile from " << paths.size() << " run(s), " << rows.size()
+       << " function(s):\n";
+    ss << "  Runs %  Median first ms  Compiles/run  Tier          Function Name\n";
+    ss << "-------- ---------------- ------------- ------------- ------------------------------\n";
+    for (size_t i = 0; i < rows.size() && i < top; ++i) {
+      const Row &row = rows[i];
+      ss << std::setw(8) << 100.0 * row.fraction << " " << std::setw(16) << row.median_us / 1000.0
+         << " " << std::setw(13) << row.compiles_per_run << " " << std::left << std::setw(13)
+         << row.tier << std::right << " " << row.name << "\n";
+    }
+
+    if (!output_path.empty()) {
+      std::ofstream out(output_path);
+      if (!out) {
+        ss << "Cannot write " << output_path;
+        result.AppendMessage(ss.str().c_str());
+        result.SetStatus(eReturnStatusFailed);
+        return false;
+      }
+      // One function per line: name, median first-compile ms, run fraction, tier
+      out << "# dart-jit warmup profile: " << paths.size() << " runs\n";
+      out << std::fixed << std::setprecision(3);
+      for (const auto &row : rows) {
+        out << row.name << "\t" << row.median_us / 1000.0 << "\t" << row.fraction << "\t"
+            << row.tier << "\n";
+      }
+      ss << "Wrote " << rows.size() << " function(s) to " << output_path << ".";
+    }
+
+    result.AppendMessage(ss.str().c_str());
+    result.SetStatus(eReturnStatusSuccessFinishResult);
+    return true;
+  }
+};
+
+// Stop-free PMU sampling of the inferior with perf_event_open (Linux only).
+// Samples land in per-thread ring buffers that a background thread drains
+// and attributes to registered JIT functions as they arrive.
+#ifdef __linux__
+struct PmuRing {
+  int fd;
+  uint8_t *base;      // metadata page followed by the data area
+  uint64_t data_size;
+};
+struct PmuSession {
+  std::string event;
+  std::vector<PmuRing> rings;
+  size_t map_bytes = 0;
+  std::thread reader;
+  std::atomic<bool> stopping{false};
+  bool running = false;
+  std::chrono::steady_clock::time_point started;
+  uint64_t elapsed_ms = 0;
+
+  std::mutex mutex;  // guards the results below
+  std::unordered_map<uint64_t, uint64_t> by_function;
+  uint64_t samples = 0;
+  uint64_t outside_jit = 0;
+  uint64_t lost = 0;
+
+  // Still sampling at plugin unload: the reader must not outlive us
+  ~PmuSession() {
+    stopping = true;
+    if (reader.joinable()) {
+      reader.join();
+    }
+  }
+};
+static std::mutex g_pmu_mutex;
+static std::unique_ptr<PmuSession> g_pmu;
+
+static const std::pair<const char *, uint64_t> kPmuEvents[] = {
+    {"cycles", PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_COUNT_HW_INSTRUCTIONS},
+    {"cache-misses", PERF_COUNT_HW_CACHE_MISSES},
+    {"branch-misses", PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+// Helper: copy len bytes at offset out of a ring buffer's data area
+static void CopyFromPmuRing(const uint8_t *data, uint64_t size, uint64_t offset, void *dst,
+                            size_t len) {
+  uint64_t pos = offset % size;
+  size_t first = std::min<uint64_t>(len, size - pos);
+  memcpy(dst, data + pos, first);
+  memcpy(static_cast<uint8_t *>(dst) + first, data, len - first);
+}
+
+// Helper: take every complete record out of one ring buffer
+static void DrainPmuRing(PmuRing &ring, std::vector<uint64_t> &ips, uint64_t &lost) {
+  auto *meta = reinterpret_cast<perf_event_mmap_page *>(ring.base);
+  const uint8_t *data = ring.base + sysconf(_SC_PAGESIZE);
+  uint64_t head = __atomic_load_n(&meta->data_head, __ATOMIC_ACQUIRE);
+  uint64_t tail = meta->data_tail;
+  while (tail < head) {
+    perf_event_header header;
+    CopyFromPmuRing(data, ring.data_size, tail, &header, sizeof(header));
+    if (header.size == 0) {
+      break;
+    }
+    if (header.type == PERF_RECORD_SAMPLE) {
+      uint64_t ip = 0;  // PERF_SAMPLE_IP comes first
+      CopyFromPmuRing(data, ring.data_size, tail + sizeof(header), &ip, sizeof(ip));
+      ips.push_back(ip);
+    } else if (header.type == PERF_RECORD_LOST) {
+      uint64_t body[2];  // id, lost
+      CopyFromPmuRing(data, ring.data_size, tail + sizeof(header), body, sizeof(body));
+      lost += body[1];
+    }
+    tail += header.size;
+  }
+  __atomic_store_n(&meta->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+static void PmuReader(PmuSession *session) {
+  std::vector<pollfd> fds;
+  for (const auto &ring : session->rings) {
+    fds.push_back(pollfd{ring.fd, POLLIN, 0});
+  }
+  std::vector<uint64_t> ips;
+  for (;;) {
+    bool last_pass = session->stopping.load();
+    poll(fds.data(), fds.size(), 100);
+    ips.clear();
+    uint64_t lost = 0;
+    for (auto &ring : session->rings) {
+      DrainPmuRing(ring, ips, lost);
+    }
+
+    std::vector<uint64_t> starts(ips.size(), 0);
+    {
+      std::lock_guard<std::mutex> lock(g_jit_mutex);
+      for (size_t i = 0; i < ips.size(); ++i) {
+        LookupJITFunctionLocked(ips[i], starts[i]);
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(session->mutex);
+      for (uint64_t start : starts) {
+        if (start) {
+          session->by_function[start]++;
+        } else {
+          session->outside_jit++;
+        }
+      }
+      session->samples += ips.size();
+      session->lost += lost;
+    }
+    if (last_pass) {
+      return;
+    }
+  }
+}
+
+// Helper: stop sampling and release the kernel resources; results are kept
+static void StopPmuSession(PmuSession &session) {
+  if (!session.running) {
+    return;
+  }
+  for (const auto &ring : session.rings) {
+    ioctl(ring.fd, PERF_EVENT_IOC_DISABLE, 0);
+  }
+  session.stopping = true;
+  session.reader.join();
+  for (const auto &ring : session.rings) {
+    munmap(ring.base, session.map_bytes);
+    close(ring.fd);
+  }
+  session.rings.clear();
+  session.running = false;
+  session.elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                           std::chrono::steady_clock::now() - session.started).count();
+}
+#endif
+
+// Hardware-counter sampling of JIT code without stopping the inferior
+class DartJITPmuCommand : public SBCommandPluginInterface {
+public:
+  bool DoExecute(SBDebugger debugger, char **command,
+                 SBCommandReturnObject &result) override {
+    std::string action = (command && command[0]) ? command[0] : "";
+#ifdef __linux__
+    if (action == "start") {
+      return Start(debugger, command + 1, result);
+    }
+    if (action == "stop" || action == "report" || action == "clear") {
+      std::lock_guard<std::mutex> lock(g_pmu_mutex);
+      if (!g_pmu) {
+        result.AppendMessage("No PMU session. Start one with 'dart-jit pmu start'.");
+        result.SetStatus(eReturnStatusFailed);
+        return false;
+      }
+      if (action == "clear") {
+        StopPmuSession(*g_pmu);
+        g_pmu.reset();
+        result.AppendMessage("PMU session discarded.");
+        result.SetStatus(eReturnStatusSuccessFinishNoResult);
+        return true;
+      }
+      if (action == "stop") {
+        StopPmuSession(*g_pmu);
+      }
+      size_t top = (command[1]) ? strtoull(command[1], nullptr, 0) : 20;
+      Report(*g_pmu, top, result);
+      return true;
+    }
+    result.AppendMessage(
+        "Usage: dart-jit pmu start [--event cycles|instructions|cache-misses|branch-misses]\n"
+        "                          [--freq HZ | --period N]\n"
+        "       dart-jit pmu report [N] | stop [N] | clear\n"
+        "Samples the debugged process with perf_event_open on every thread and\n"
+        "attributes the sampled IPs to registered JIT functions in the\n"
+        "background, without stopping the process. Local targets only.");
+#else
+    result.AppendMessage("dart-jit pmu needs perf_event_open and is only available on Linux.");
+#endif
+    result.SetStatus(eReturnStatusFailed);
+    return false;
+  }
+
+#ifdef __linux__
+private:
+  bool Start(SBDebugger &debugger, char **args, SBCommandReturnObject &result) {
+    std::string event = "cycles";
+    uint64_t freq = 1000;
+    uint64_t period = 0;
+    for (char **arg = args; arg && *arg; ++arg) {
+      std::string opt = *arg;
+      if (opt == "--event" && arg[1]) {
+        event = *++arg;
+      } else if (opt == "--freq" && arg[1]) {
+        freq = strtoull(*++arg, nullptr, 0);
+      } else if (opt == "--period" && arg[1]) {
+        period = strtoull(*++arg, nullptr, 0);
+      } else {
+        result.AppendMessage("Unknown option. Use 'dart-jit pmu' for help.");
+        result.SetStatus(eReturnStatusFailed);
+        return false;
+      }
+    }
+    const std::pair<const char *, uint64_t> *config = nullptr;
+    for (const auto &candidate : kPmuEvents) {
+      if (event == candidate.first) {
+        config = &candidate;
+      }
+    }
+    if (!config) {
+      result.AppendMessage("Unknown event. Use cycles, instructions, cache-misses or branch-misses.");
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    SBProcess process = debugger.GetSelectedTarget().GetProcess();
+    if (!process.IsValid()) {
+      result.AppendMessage("No valid process. Please run the program first.");
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(g_pmu_mutex);
+    if (g_pmu && g_pmu->running) {
+      result.AppendMessage("A PMU session is already running; 'dart-jit pmu stop' it first.");
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    std::string task_dir = "/proc/" + std::to_string(process.GetProcessID()) + "/task";
+    DIR *dir = opendir(task_dir.c_str());
+    if (!dir) {
+      result.AppendMessage("Cannot list the process's threads; dart-jit pmu only works on local targets.");
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+    std::vector<pid_t> tids;
+    while (dirent *entry = readdir(dir)) {
+      if (isdigit(static_cast<unsigned char>(entry->d_name[0]))) {
+        tids.push_back(static_cast<pid_t>(strtol(entry->d_name, nullptr, 10)));
+      }
+    }
+    closedir(dir);
+
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config->second;
+    if (period) {
+      attr.sample_period = period;
+    } else {
+      attr.freq = 1;
+      attr.sample_freq = freq;
+    }
+    attr.sample_type = PERF_SAMPLE_IP | PERF_SAMPLE_TID;
+    attr.disabled = 1;
+    attr.inherit = 1;  // threads started later report into their creator's buffer
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    const size_t kDataPages = 64;
+    long page_size = sysconf(_SC_PAGESIZE);
+    auto session = std::unique_ptr<PmuSession>(new PmuSession());
+    session->event = event;
+    session->map_bytes = (1 + kDataPages) * page_size;
+    std::string failure;
+    for (pid_t tid : tids) {
+      int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, tid, -1, -1, PERF_FLAG_FD_CLOEXEC));
+      if (fd < 0) {
+        if (errno == ESRCH) {
+          continue;  // the thread exited meanwhile
+        }
+        failure = std::string("perf_event_open failed: ") + strerror(errno);
+        if (errno == EACCES || errno == EPERM) {
+          failure += " (check /proc/sys/kernel/perf_event_paranoid)";
+        }
+        break;
+      }
+      void *base = mmap(nullptr, session->map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (base == MAP_FAILED) {
+        failure = std::string("mmap of the sample buffer failed: ") + strerror(errno);
+        close(fd);
+        break;
+      }
+      session->rings.push_back(PmuRing{fd, static_cast<uint8_t *>(base), kDataPages * page_size});
+    }
+    if (failure.empty() && session->rings.empty()) {
+      failure = "no threads to sample";
+    }
+    if (!failure.empty()) {
+      for (const auto &ring : session->rings) {
+        munmap(ring.base, session->map_bytes);
+        close(ring.fd);
+      }
+      result.AppendMessage(failure.c_str());
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    session->running = true;
+    session->started = std::chrono::steady_clock::now();
+    session->reader = std::thread(PmuReader, session.get());
+    for (const auto &ring : session->rings) {
+      ioctl(ring.fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    std::stringstream ss;
+    ss << "Sampling " << event << " on " << session->rings.size() << " thread(s) of pid "
+       << process.GetProcessID() << ". Use 'dart-jit pmu report' while it runs.";
+    g_pmu = std::move(session);
+    result.AppendMessage(ss.str().c_str());
+    result.SetStatus(eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+  void Report(PmuSession &session, size_t top, SBCommandReturnObject &result) {
+    std::vector<std::pair<uint64_t, uint64_t>> rows;  // (samples, function)
+    uint64_t samples = 0;
+    uint64_t outside = 0;
+    uint64_t lost = 0;
+    {
+      std::lock_guard<std::mutex> lock(session.mutex);
+      for (const auto &pair : session.by_function) {
+        rows.emplace_back(pair.second, pair.first);
+      }
+      samples = session.samples;
+      outside = session.outside_jit;
+      lost = session.lost;
+    }
+    std::sort(rows.begin(), rows.end(), std::greater<std::pair<uint64_t, uint64_t>>());
+    uint64_t elapsed_ms = session.running
+                              ? std::chrono::duration_cast<std::chrono::milliseconds>(
+                                    std::chrono::steady_clock::now() - session.started).count()
+                              : session.elapsed_ms;
+
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(2);
+    ss << session.event << " samples: " << samples << " over " << elapsed_ms / 1000.0 << " s ("
+       << (session.running ? "running" : "stopped") << "), " << samples - outside
+       << " in JIT code, " << outside << " elsewhere, " << lost << " lost\n";
+    ss << " Samples       %  Function Name\n";
+    ss << "-------- -------  ------------------------------\n";
+    {
+      std::lock_guard<std::mutex> lock(g_jit_mutex);
+      for (size_t i = 0; i < rows.size() && i < top; ++i) {
+        ss << std::setw(8) << rows[i].first << " " << std::setw(6)
+           << 100.0 * rows[i].first / std::max<uint64_t>(1, samples) << "%  "
+           << g_jit_functions[rows[i].second] << "\n";
+      }
+    }
+    result.AppendMessage(ss.str().c_str());
+    result.SetStatus(eReturnStatusSuccessFinishResult);
+  }
+#endif
+};
+
+// Stub-aware stepping
+
+// Where control leaves a stub: direct targets outside it (operands that are
+// a bare address) are run to, and every other branch or return is run to
+// and then stepped over once.
+struct StubExits {
+  uint64_t size = 0;
+  std::vector<uint64_t> run_to;
+  std::vector<uint64_t> step_at;
+};
+static std::mutex g_stub_exits_mutex;
+static std::unordered_map<uint64_t, StubExits> g_stub_exits;
+
+// Helper: exits of the stub at start, computed once per stub
+static StubExits GetStubExits(SBTarget &target, SBProcess &process, uint64_t start, uint64_t size) {
+  {
+    std::lock_guard<std::mutex> lock(g_stub_exits_mutex);
+    auto it = g_stub_exits.find(start);
+    if (it != g_stub_exits.end() && it->second.size == size) {
+      return it->second;
+    }
+  }
+
+  StubExits exits;
+  exits.size = size;
+  for (const auto &transfer : DecodeControlTransfers(target, process, start, size)) {
+    if (!transfer.has_target) {
+      exits.step_at.push_back(transfer.addr);
+      continue;
+    }
+    if (transfer.dest >= start && transfer.dest < start + size) {
+      continue;
+    }
+    // Direct calls into the runtime come back to the stub
+    if (transfer.is_call && ClassifyJITAddress(transfer.dest) == kCodeNative) {
+      continue;
+    }
+    exits.run_to.push_back(transfer.dest);
+  }
+
+  std::lock_guard<std::mutex> lock(g_stub_exits_mutex);
+  g_stub_exits[start] = exits;
+  return exits;
+}
+
+// How a bounded run to a set of addresses ended
+enum RunToResult { kRunReached, kRunNoBreakpoints, kRunStoppedElsewhere, kRunTimedOut };
+
+// Helper: resume thread until it reaches one of addrs, using thread-specific
+// breakpoints that are removed again afterwards. Addresses whose breakpoint
+// resolves to no location are skipped; with require_all, any such address
+// means the process is not resumed at all. The resume is bounded: the
+// process is resumed asynchronously and stopped again if no stop arrives
+// within timeout_s seconds. Leaves the debugger synchronous.
+static RunToResult RunToAnyAddress(SBTarget &target, SBProcess &process, SBThread &thread,
+                                   const std::vector<uint64_t> &addrs, uint32_t timeout_s,
+                                   bool require_all) {
+  std::vector<break_id_t> ids;
+  size_t unresolved = 0;
+  for (uint64_t addr : addrs) {
+    SBBreakpoint bp = target.BreakpointCreateByAddress(addr);
+    if (!bp.IsValid()) {
+      ++unresolved;
+      continue;
+    }
+    if (bp.GetNumLocations() == 0) {
+      target.BreakpointDelete(bp.GetID());
+      ++unresolved;
+      continue;
+    }
+    bp.SetThreadID(thread.GetThreadID());
+    bp.AddName("dart-jit-step");
+    ids.push_back(bp.GetID());
+  }
+  if (ids.empty() || (require_all && unresolved)) {
+    for (break_id_t id : ids) {
+      target.BreakpointDelete(id);
+    }
+    return kRunNoBreakpoints;
+  }
+
+  // Wait for the stop ourselves rather than in a synchronous Continue, which
+  // would only return once something unrelated stops the process
+  SBDebugger debugger = target.GetDebugger();
+  SBListener listener("dart-jit-step");
+  SBBroadcaster broadcaster = process.GetBroadcaster();
+  listener.StartListeningForEvents(broadcaster, SBProcess::eBroadcastBitStateChanged);
+  debugger.SetAsync(true);
+  bool resumed = process.Continue().Success();
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(timeout_s);
+  bool timed_out = false;
+  while (resumed) {
+    if (std::chrono::steady_clock::now() >= deadline) {
+      if (timed_out) {
+        break;  // the interrupt was not acknowledged either
+      }
+      timed_out = true;
+      process.Stop();
+      deadline = std::chrono::steady_clock::now() + std::chrono::seconds(timeout_s);
+    }
+    SBEvent event;
+    if (!listener.WaitForEvent(1, event)) {
+      continue;
+    }
+    StateType state = SBProcess::GetStateFromEvent(event);
+    if (state == eStateStopped && SBProcess::GetRestartedFromEvent(event)) {
+      continue;  // an auto-continuing breakpoint, such as the plugin's own
+    }
+    if (state == eStateStopped || state == eStateExited || state == eStateCrashed ||
+        state == eStateDetached) {
+      break;
+    }
+  }
+  listener.StopListeningForEvents(broadcaster, SBProcess::eBroadcastBitStateChanged);
+  debugger.SetAsync(false);
+
+  for (break_id_t id : ids) {
+    target.BreakpointDelete(id);
+  }
+  if (timed_out) {
+    return kRunTimedOut;
+  }
+  if (process.GetState() != eStateStopped || !thread.IsValid()) {
+    return kRunStoppedElsewhere;
+  }
+  uint64_t pc = thread.GetFrameAtIndex(0).GetPC();
+  return std::find(addrs.begin(), addrs.end(), pc) != addrs.end() ? kRunReached
+                                                                    : kRunStoppedElsewhere;
+}
+
+// Helper: why a run to a set of addresses did not get there
+static std::string DescribeRunFailure(RunToResult run, const char *where, uint32_t timeout_s) {
+  switch (run) {
+  case kRunNoBreakpoints:
+    return std::string("no breakpoint could be placed on the exits of ") + where;
+  case kRunTimedOut:
+    return "no exit of " + std::string(where) + " was reached within " +
+           std::to_string(timeout_s) + " s, so the process was interrupted";
+  default:
+    return std::string("the thread stopped inside ") + where + " for another reason";
+  }
+}
+
+// Cumulative step latency per mode, so the stub-aware plan can be compared
+// with plain instruction stepping.
+struct StepTotals {
+  uint64_t runs = 0;
+  uint64_t stops = 0;
+  uint64_t us = 0;
+};
+static StepTotals g_step_totals[2];  // [0] run-through, [1] single-step
+
+// Step into the next call and run through VM stubs to the first Dart function
+class DartJITStepCommand : public SBCommandPluginInterface {
+public:
+  bool DoExecute(SBDebugger debugger, char **command,
+                 SBCommandReturnObject &result) override {
+    bool single_step = false;
+    uint64_t max_stops = 256;
+    uint32_t timeout_s = 10;
+    for (char **arg = command; arg && *arg; ++arg) {
+      std::string opt = *arg;
+      if (opt == "--single-step") {
+        single_step = true;
+      } else if (opt == "--max-stops" && arg[1]) {
+        max_stops = strtoull(*++arg, nullptr, 0);
+      } else if (opt == "--timeout" && arg[1]) {
+        timeout_s = std::max<uint32_t>(1, strtoul(*++arg, nullptr, 0));
+      } else if (opt == "--stats") {
+        ReportTotals(result);
+        return true;
+      } else {
+        result.AppendMessage(
+            "Usage: dart-jit step [--single-step] [--max-stops N] [--timeout S] | --stats\n"
+            "Runs the selected thread to the next call or return of the current\n"
+            "function, steps it, then runs through VM stubs and trampolines at\n"
+            "full speed (stepping out of runtime code) until the first compiled\n"
+            "Dart function is reached. --single-step instruction-steps through\n"
+            "the stubs instead, as a baseline; --stats compares both modes.\n"
+            "A run that reaches no exit within --timeout seconds (default 10)\n"
+            "is interrupted.");
+        result.SetStatus(eReturnStatusFailed);
+        return false;
+      }
+    }
+
+    SBTarget target = debugger.GetSelectedTarget();
+    SBProcess process = target.GetProcess();
+    if (!target.IsValid() || !process.IsValid() || process.GetState() != eStateStopped) {
+      result.AppendMessage("No stopped process. Please run the program to a stop first.");
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+    SBThread thread = process.GetSelectedThread();
+    if (!thread.IsValid()) {
+      result.AppendMessage("No selected thread.");
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    // The loop below needs each resume to return only once the thread stops
+    bool was_async = debugger.GetAsync();
+    debugger.SetAsync(false);
+    auto started = std::chrono::steady_clock::now();
+    uint64_t stops = 0;
+    uint64_t stub_stops = 0;
+    uint64_t native_stops = 0;
+    std::string failure;
+
+    // Leave the current function through its next call or return
+    uint64_t pc = thread.GetFrameAtIndex(0).GetPC();
+    uint64_t start = 0;
+    uint64_t size = 0;
+    if (ClassifyJITAddress(pc, start, size) == kCodeFunction) {
+      std::vector<uint64_t> exits;
+      bool at_exit = false;
+      for (const auto &transfer : DecodeControlTransfers(target, process, start, size)) {
+        if (transfer.is_call || transfer.is_return) {
+          exits.push_back(transfer.addr);
+          at_exit = at_exit || transfer.addr == pc;
+        }
+      }
+      if (!at_exit) {
+        RunToResult run = RunToAnyAddress(target, process, thread, exits, timeout_s, false);
+        if (run != kRunReached) {
+          failure = DescribeRunFailure(run, "the current function", timeout_s);
+        }
+        ++stops;
+      }
+      if (failure.empty()) {
+        thread.StepInstruction(false);
+        ++stops;
+      }
+    }
+
+    // Then run through stubs and runtime code
+    JITCodeKind kind = kCodeNative;
+    while (failure.empty() && process.GetState() == eStateStopped && stops < max_stops) {
+      pc = thread.GetFrameAtIndex(0).GetPC();
+      kind = ClassifyJITAddress(pc, start, size);
+      if (kind == kCodeFunction) {
+        break;
+      }
+      if (kind == kCodeNative) {
+        SBError error;
+        thread.StepOut(error);
+        if (error.Fail()) {
+          failure = std::string("cannot step out of native code: ") +
+                    (error.GetCString() ? error.GetCString() : "unknown error");
+        }
+        ++stops;
+        ++native_stops;
+        continue;
+      }
+      ++stub_stops;
+      if (single_step) {
+        thread.StepInstruction(false);
+        ++stops;
+        continue;
+      }
+      StubExits exits = GetStubExits(target, process, start, size);
+      std::vector<uint64_t> addrs = exits.run_to;
+      addrs.insert(addrs.end(), exits.step_at.begin(), exits.step_at.end());
+      bool at_step = std::find(exits.step_at.begin(), exits.step_at.end(), pc) !=
+                     exits.step_at.end();
+      if (!at_step) {
+        // Running is only safe when every exit has a breakpoint; otherwise
+        // the thread could leave unseen. Fall back to stepping.
+        RunToResult run = addrs.empty()
+                              ? kRunNoBreakpoints
+                              : RunToAnyAddress(target, process, thread, addrs, timeout_s, true);
+        if (run == kRunNoBreakpoints) {
+          thread.StepInstruction(false);
+          ++stops;
+          continue;
+        }
+        if (run != kRunReached) {
+          failure = DescribeRunFailure(run, "a stub", timeout_s);
+          break;
+        }
+        ++stops;
+        pc = thread.GetFrameAtIndex(0).GetPC();
+        at_step = std::find(exits.step_at.begin(), exits.step_at.end(), pc) !=
+                  exits.step_at.end();
+      }
+      if (at_step) {
+        thread.StepInstruction(false);
+        ++stops;
+      }
+    }
+
+    debugger.SetAsync(was_async);
+    uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::steady_clock::now() - started).count();
+    StepTotals &totals = g_step_totals[single_step ? 1 : 0];
+    totals.runs++;
+    totals.stops += stops;
+    totals.us += us;
+
+    std::stringstream ss;
+    if (!failure.empty()) {
+      ss << "Step stopped early: " << failure << ".\n";
+    } else if (kind != kCodeFunction) {
+      ss << "Gave up after " << stops << " stops without reaching a Dart function.\n";
+    }
+    if (process.GetState() == eStateStopped && thread.IsValid()) {
+      ss << "Stopped at " << SymbolizeJITAddress(thread.GetFrameAtIndex(0).GetPC()) << "\n";
+    }
+    ss << std::fixed << std::setprecision(2);
+    ss << stops << " stops (" << stub_stops << " in stubs, " << native_stops
+       << " in runtime code) in " << us / 1000.0 << " ms"
+       << (single_step ? " [single-step]" : "");
+    result.AppendMessage(ss.str().c_str());
+    result.SetStatus(failure.empty() && kind == kCodeFunction ? eReturnStatusSuccessFinishResult
+                                                              : eReturnStatusFailed);
+    return failure.empty();
+  }
+
+private:
+  void ReportTotals(SBCommandReturnObject &result) {
+    static const char *const kModes[2] = {"run-through", "single-step"};
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(2);
+    ss << "Mode          Steps  Avg stops   Avg ms\n";
+    ss << "------------ ------ ---------- --------\n";
+    for (int mode = 0; mode < 2; ++mode) {
+      const StepTotals &totals = g_step_totals[mode];
+      double runs = std::max<uint64_t>(1, totals.runs);
+      ss << std::left << std::setw(12) << kModes[mode] << std::right << " "
+         << std::setw(6) << totals.runs << " " << std::setw(10) << totals.stops / runs
+         << " " << std::setw(8) << totals.us / runs / 1000.0 << "\n";
+    }
+    result.AppendMessage(ss.str().c_str());
+    result.SetStatus(eReturnStatusSuccessFinishResult);
+  }
+};
+
+// Helper: sorted snapshot of the per-thread registration stats
+static std::vector<std::pair<uint64_t, JITThreadStats>> SnapshotThreadStats() {
+  std::vector<std::pair<uint64_t, JITThreadStats>> threads;
+  {
+    std::lock_guard<std::mutex> lock(g_jit_mutex);
+    threads.assign(g_jit_thread_stats.begin(), g_jit_thread_stats.end());
+  }
+  std::sort(threads.begin(), threads.end(), [](const auto &a, const auto &b) {
+    return a.second.registrations > b.second.registrations;
+  });
+  return threads;
+}
+
+// Registration counts, code bytes and stop time broken down by thread
+class DartJITStatsCommand : public SBCommandPluginInterface {
+public:
+  bool DoExecute(SBDebugger debugger, char **command,
+                 SBCommandReturnObject &result) override {
+    auto threads = SnapshotThreadStats();
+    if (threads.empty()) {
+      result.AppendMessage("No JIT registrations observed yet.");
+      result.SetStatus(eReturnStatusSuccessFinishResult);
+      return true;
+    }
+
+    JITThreadStats total;
+    for (const auto &pair : threads) {
+      total.registrations += pair.second.registrations;
+      total.bytes += pair.second.bytes;
+      total.stop_ns += pair.second.stop_ns;
+      total.stops += pair.second.stops;
+    }
+
+    std::stringstream ss;
+    ss << "JIT registrations by thread:\n";
+    ss << "----------------------------\n";
+    ss << "Thread                         Regs     Regs%  Bytes      Stops    Stop ms   Avg us\n";
+    ss << "------------------------------ -------- ------ ---------- -------- --------- -------\n";
+    ss << std::fixed;
+    for (const auto &pair : threads) {
+      const JITThreadStats &t = pair.second;
+      ss << std::left << std::setw(30) << ThreadLabel(pair.first, t.name) << " " << std::right
+         << std::setw(8) << t.registrations << " "
+         << std::setprecision(1) << std::setw(6)
+         << 100.0 * t.registrations / std::max<uint64_t>(1, total.registrations) << " "
+         << std::setw(10) << t.bytes << " "
+         << std::setw(8) << t.stops << " "
+         << std::setprecision(2) << std::setw(9) << t.stop_ns / 1e6 << " "
+         << std::setprecision(1) << std::setw(7)
+         << t.stop_ns / 1e3 / std::max<uint64_t>(1, t.stops) << "\n";
+    }
+    ss << "\nTotal: " << total.registrations << " registrations, " << total.bytes
+       << " bytes, " << total.stops << " stops, " << std::setprecision(2)
+       << total.stop_ns / 1e6 << " ms stopped in the registration callback.";
+
+    result.AppendMessage(ss.str().c_str());
+    result.SetStatus(eReturnStatusSuccessFinishResult);
+    return true;
+  }
+};
+
+// Code size breakdown by registering thread, plus the largest functions
+class DartJITSizesCommand : public SBCommandPluginInterface {
+public:
+  bool DoExecute(SBDebugger debugger, char **command,
+                 SBCommandReturnObject &result) override {
+    size_t top = (command && command[0]) ? strtoull(command[0], nullptr, 0) : 10;
+
+    struct SizeStats {
+      uint64_t count = 0;
+      uint64_t bytes = 0;
+      uint64_t max = 0;
+    };
+    std::unordered_map<uint64_t, SizeStats> by_thread;
+    std::vector<std::pair<uint64_t, uint64_t>> largest;  // (size, addr)
+    std::unordered_map<uint64_t, std::string> names;
+    std::unordered_map<uint64_t, std::string> thread_names;
+    {
+      std::lock_guard<std::mutex> lock(g_jit_mutex);
+      for (const auto &pair : g_jit_sizes) {
+        auto tid_it = g_jit_thread_ids.find(pair.first);
+        uint64_t tid = (tid_it != g_jit_thread_ids.end()) ? tid_it->second : 0;
+        SizeStats &stats = by_thread[tid];
+        stats.count++;
+        stats.bytes += pair.second;
+        stats.max = std::max(stats.max, pair.second);
+        largest.emplace_back(pair.second, pair.first);
+      }
+      for (const auto &pair : g_jit_thread_stats) {
+        thread_names[pair.first] = pair.second.name;
+      }
+      std::sort(largest.begin(), largest.end(), std::greater<std::pair<uint64_t, uint64_t>>());
+      if (largest.size() > top) {
+        largest.resize(top);
+      }
+      for (const auto &entry : largest) {
+        names[entry.second] = g_jit_functions[entry.second];
+      }
+    }
+
+    if (by_thread.empty()) {
+      result.AppendMessage("No JIT-compiled Dart functions registered.");
+      result.SetStatus(eReturnStatusSuccessFinishResult);
+      return true;
+    }
+
+    std::stringstream ss;
+    ss << "JIT code size by thread:\n";
+    ss << "------------------------\n";
+    ss << "Thread                         Functions  Bytes        Avg      Max\n";
+    ss << "------------------------------ ---------- ------------ -------- --------\n";
+    for (const auto &pair : by_thread) {
+      const SizeStats &stats = pair.second;
+      std::string label = pair.first ? ThreadLabel(pair.first, thread_names[pair.first])
+                                     : "<added manually>";
+      ss << std::left << std::setw(30) << label << " " << std::right
+         << std::setw(10) << stats.count << " "
+         << std::setw(12) << stats.bytes << " "
+         << std::setw(8) << stats.bytes / stats.count << " "
+         << std::setw(8) << stats.max << "\n";
+    }
+
+    ss << "\nLargest functions:\n";
+    for (const auto &entry : largest) {
+      char addr_str[32];
+      snprintf(addr_str, sizeof(addr_str), "0x%016" PRIX64, entry.second);
+      ss << "  " << addr_str << " " << std::setw(8) << entry.first << " "
+         << names[entry.second] << "\n";
+    }
+
+    result.AppendMessage(ss.str().c_str());
+    result.SetStatus(eReturnStatusSuccessFinishResult);
+    return true;
+  }
+};
+
+// Allocation profiler driven by counting breakpoints on allocation stubs
+class DartJITAllocProfCommand : public SBCommandPluginInterface {
+public:
+  bool DoExecute(SBDebugger debugger, char **command,
+                 SBCommandReturnObject &result) override {
+    std::string action = (command && command[0]) ? command[0] : "";
+    SBTarget target = debugger.GetSelectedTarget();
+
+    if (action == "start") {
+      if (!target.IsValid()) {
+        result.AppendMessage("No valid target selected. Please select a target first.");
+        result.SetStatus(eReturnStatusFailed);
+        return false;
+      }
+      std::string tags_reg = AllocTagsRegisterForTarget(target);
+      for (char **arg = command + 1; *arg; ++arg) {
+        std::string opt = *arg;
+        if (opt == "--pattern" && arg[1]) {
+          g_allocprof_pattern = *++arg;
+        } else if (opt == "--tags-reg" && arg[1]) {
+          tags_reg = *++arg;
+        } else {
+          return Usage(result);
+        }
+      }
+      if (tags_reg.empty()) {
+        result.AppendMessage("No known allocation stub tags register for this architecture. "
+                             "Pass --tags-reg <reg>.");
+        result.SetStatus(eReturnStatusFailed);
+        return false;
+      }
+
+      std::vector<std::pair<uint64_t, std::string>> stubs;
+      {
+        std::lock_guard<std::mutex> lock(g_jit_mutex);
+        for (const auto &pair : g_jit_functions) {
+          if (IsAllocStubLocked(pair.first, pair.second)) {
+            stubs.push_back(pair);
+          }
+        }
+      }
+
+      size_t attached = 0;
+      {
+        std::lock_guard<std::mutex> lock(g_alloc_mutex);
+        g_allocprof_tags_reg = tags_reg;
+        g_allocprof_active = true;
+        for (const auto &stub : stubs) {
+          attached += AttachAllocStubLocked(target, stub.first, stub.second);
+        }
+      }
+
+      std::stringstream ss;
+      ss << "Allocation profiling started: " << attached << " stub(s) matching '"
+         << g_allocprof_pattern << "' instrumented, tags read from " << tags_reg
+         << ". Stubs registered later are picked up automatically.";
+      result.AppendMessage(ss.str().c_str());
+      result.SetStatus(eReturnStatusSuccessFinishResult);
+      return true;
+    }
+
+    if (action == "stop") {
+      std::lock_guard<std::mutex> lock(g_alloc_mutex);
+      g_allocprof_active = false;
+      for (const auto &stub : g_alloc_stubs) {
+        if (target.IsValid()) {
+          target.BreakpointDelete(stub->bp_id);
+        }
+      }
+      std::stringstream ss;
+      ss << "Allocation profiling stopped, removed " << g_alloc_stubs.size()
+         << " breakpoint(s).";
+      g_alloc_stubs.clear();
+      result.AppendMessage(ss.str().c_str());
+      result.SetStatus(eReturnStatusSuccessFinishResult);
+      return true;
+    }
+
+    if (action == "clear") {
+      std::lock_guard<std::mutex> lock(g_alloc_mutex);
+      g_alloc_counts.clear();
+      result.AppendMessage("Allocation profile cleared.");
+      result.SetStatus(eReturnStatusSuccessFinishResult);
+      return true;
+    }
+
+    if (action == "report") {
+      size_t top = command[1] ? strtoull(command[1], nullptr, 0) : 20;
+      std::vector<std::pair<uint64_t, std::pair<std::string, uint64_t>>> sites;
+      std::unordered_map<std::string, uint64_t> by_class;
+      uint64_t total = 0;
+      {
+        std::lock_guard<std::mutex> lock(g_alloc_mutex);
+        for (const auto &pair : g_alloc_counts) {
+          sites.emplace_back(pair.second, pair.first);
+          by_class[pair.first.first] += pair.second;
+          total += pair.second;
+        }
+      }
+      if (total == 0) {
+        result.AppendMessage("No allocations recorded. Use 'dart-jit allocprof start' first.");
+        result.SetStatus(eReturnStatusSuccessFinishResult);
+        return true;
+      }
+      std::sort(sites.begin(), sites.end(), [](const auto &a, const auto &b) {
+        return a.first > b.first;
+      });
+      std::vector<std::pair<uint64_t, std::string>> classes;
+      for (const auto &pair : by_class) {
+        classes.emplace_back(pair.second, pair.first);
+      }
+      std::sort(classes.begin(), classes.end(), std::greater<std::pair<uint64_t, std::string>>());
+
+      std::stringstream ss;
+      ss << std::fixed << std::setprecision(1);
+      ss << "Top allocation sites (" << total << " allocations):\n";
+      ss << "Count      %      Class                          Call site\n";
+      ss << "---------- ------ ------------------------------ ------------------------------\n";
+      for (size_t i = 0; i < sites.size() && i < top; ++i) {
+        std::string class_name = sites[i].second.first;
+        if (class_name.length() > 30) {
+          class_name = class_name.substr(0, 27) + "...";
+        }
+        ss << std::left << std::setw(10) << sites[i].first << " " << std::right
+           << std::setw(6) << 100.0 * sites[i].first / total << " " << std::left
+           << std::setw(30) << class_name << " " << std::right
+           << SymbolizeJITAddress(sites[i].second.second) << "\n";
+      }
+      ss << "\nAllocations by class:\n";
+      for (size_t i = 0; i < classes.size() && i < top; ++i) {
+        ss << std::left << std::setw(10) << classes[i].first << " " << std::right
+           << std::setw(6) << 100.0 * classes[i].first / total << " "
+           << classes[i].second << "\n";
+      }
+      result.AppendMessage(ss.str().c_str());
+      result.SetStatus(eReturnStatusSuccessFinishResult);
+      return true;
+    }
+
+    return Usage(result);
+  }
+
+private:
+  bool Usage(SBCommandReturnObject &result) {
+    result.AppendMessage(
+        "Usage: dart-jit allocprof start [--pattern <text>] [--tags-reg <reg>]\n"
+        "       dart-jit allocprof report [N]\n"
+        "       dart-jit allocprof stop | clear\n"
+        "Counts allocations per class and call site with auto-continuing\n"
+        "breakpoints on the registered allocation stubs (stubs whose names\n"
+        "contain 'Allocate' by default). Generic stubs read the object tags\n"
+        "from --tags-reg (default: the AllocateObjectABI tags register, r8 on\n"
+        "x64 and x4 on arm64; other architectures must pass it).");
+    result.SetStatus(eReturnStatusFailed);
+    return false;
+  }
+};
+
+// Per-class totals gathered by a heap walk
+struct DartHeapClassStats {
+  uint64_t count = 0;
+  uint64_t bytes = 0;
+};
+
+// How to size an object too large for its header's size tag: read the Smi
+// length field at length_offset and add data_offset + length * element_size.
+struct DartVarSizeRule {
+  uint32_t length_offset;
+  uint32_t data_offset;
+  uint32_t element_size;
+};
+
+// Helper: size rules for the variable-length classes the census knows how to
+// decode, keyed by class id. field_size is the size of an object pointer
+// field (4 with compressed pointers); the tags word is always word_size.
+static std::unordered_map<uint32_t, DartVarSizeRule>
+VarSizeRulesForTarget(SBTarget &target, uint32_t word_size, uint32_t field_size) {
+  ClassNameForCid(target, 0);  // loads g_class_names
+  static const std::pair<const char *, uint32_t> kTypedData[] = {
+      {"Int8Array", 1},    {"Uint8Array", 1},   {"Uint8ClampedArray", 1},
+      {"Int16Array", 2},   {"Uint16Array", 2},  {"Int32Array", 4},
+      {"Uint32Array", 4},  {"Int64Array", 8},   {"Uint64Array", 8},
+      {"Float32Array", 4}, {"Float64Array", 8}, {"Float32x4Array", 16},
+      {"Int32x4Array", 16}, {"Float64x2Array", 16}};
+  // 32-bit VMs keep the string hash in a field after the length
+  const uint32_t string_data = word_size + field_size + (word_size == 4 ? field_size : 0);
+
+  std::unordered_map<uint32_t, DartVarSizeRule> rules;
+  std::lock_guard<std::mutex> lock(g_class_name_mutex);
+  for (const auto &pair : g_class_names) {
+    const std::string &name = pair.second;
+    if (name == "Array" || name == "ImmutableArray") {
+      // tags, type_arguments, length, elements
+      rules[pair.first] = {word_size + field_size, word_size + 2 * field_size, field_size};
+    } else if (name == "OneByteString") {
+      rules[pair.first] = {word_size, string_data, 1};
+    } else if (name == "TwoByteString") {
+      rules[pair.first] = {word_size, string_data, 2};
+    } else if (name.compare(0, 9, "TypedData") == 0) {
+      // tags, data pointer, length, payload
+      for (const auto &typed : kTypedData) {
+        if (name.compare(9, std::string::npos, typed.first) == 0) {
+          rules[pair.first] = {2 * word_size, 2 * word_size + field_size, typed.second};
+        }
+      }
+    }
+  }
+  return rules;
+}
+
+// Census of the Dart heap by class, decoded straight from object headers
+class DartHeapCensusCommand : public SBCommandPluginInterface {
+public:
+  bool DoExecute(SBDebugger debugger, char **command,
+                 SBCommandReturnObject &result) override {
+    DartHeapLayout layout;
+    uint64_t page_size = 0;
+    uint64_t page_header = 0;
+    size_t num_threads = DefaultWorkerCount();
+    size_t top = 30;
+    bool compressed = false;
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+
+    for (char **arg = command; arg && *arg; ++arg) {
+      std::string opt = *arg;
+      if (opt == "--compressed") {
+        compressed = true;
+      } else if (opt.compare(0, 2, "--") == 0) {
+        if (!arg[1]) {
+          return Usage(result);
+        }
+        uint64_t value = strtoull(*++arg, nullptr, 0);
+        if (opt == "--cid-shift") {
+          layout.cid_shift = value;
+        } else if (opt == "--cid-bits") {
+          layout.cid_bits = value;
+        } else if (opt == "--size-shift") {
+          layout.size_shift = value;
+        } else if (opt == "--size-bits") {
+          layout.size_bits = value;
+        } else if (opt == "--align") {
+          layout.alignment = value;
+        } else if (opt == "--page-size") {
+          page_size = value;
+        } else if (opt == "--page-header") {
+          page_header = value;
+        } else if (opt == "--threads") {
+          num_threads = value;
+        } else if (opt == "--top") {
+          top = value;
+        } else {
+          return Usage(result);
+        }
+      } else {
+        if (!arg[1]) {
+          return Usage(result);
+        }
+        uint64_t start = strtoull(arg[0], nullptr, 0);
+        uint64_t end = strtoull(arg[1], nullptr, 0);
+        ++arg;
+        if (end <= start) {
+          return Usage(result);
+        }
+        ranges.emplace_back(start, end);
+      }
+    }
+
+    if (ranges.empty() || layout.alignment == 0 ||
+        (page_size != 0 && page_header >= page_size)) {
+      return Usage(result);
+    }
+
+    SBTarget target = debugger.GetSelectedTarget();
+    SBProcess process = target.GetProcess();
+    if (!target.IsValid() || !process.IsValid()) {
+      result.AppendMessage("No valid process. Please run the program first.");
+      result.SetStatus(eReturnStatusFailed);
+      return false;
+    }
+
+    // Split the ranges into walk units, one per heap page when a page size
+    // is given. Objects start right after each page's header.
+    std::vector<std::pair<uint64_t, uint64_t>> units;
+    for (const auto &range : ranges) {
+      if (page_size == 0) {
+        units.push_back(range);
+        continue;
+      }
+      for (uint64_t page = range.first; page < range.second; page += page_size) {
+        units.emplace_back(page + page_header, std::min(page + page_size, range.second));
+      }
+    }
+
+    const uint32_t word_size = process.GetAddressByteSize();
+    const uint64_t cid_mask = (layout.cid_bits >= 64) ? ~0ULL : ((1ULL << layout.cid_bits) - 1);
+    const uint64_t size_mask = (1ULL << layout.size_bits) - 1;
+    const uint32_t field_size = (compressed && word_size == 8) ? 4 : word_size;
+    const std::unordered_map<uint32_t, DartVarSizeRule> var_rules =
+        VarSizeRulesForTarget(target, word_size, field_size);
+
+    num_threads = std::min(std::max<size_t>(1, num_threads), units.size());
+    std::vector<std::unordered_map<uint32_t, DartHeapClassStats>> per_worker(num_threads);
+    std::vector<uint64_t> walked(units.size(), 0);
+    std::vector<uint8_t> unsized(units.size(), 0);
+    std::atomic<uint64_t> read_failures(0);
+    std::atomic<uint64_t> decoded_large(0);
+
+    // Each worker reads a whole page in one bulk read and walks it locally
+    ParallelFor(units.size(), num_threads, [&](size_t worker, size_t index) {
+      uint64_t start = units[index].first;
+      std::vector<uint8_t> buffer(units[index].second - start);
+      SBError error;
+      size_t got = process.ReadMemory(start, buffer.data(), buffer.size(), error);
+      if (error.Fail() || got != buffer.size()) {
+        ++read_failures;
+        return;
+      }
+
+      auto &stats = per_worker[worker];
+      uint64_t offset = 0;
+      while (offset + word_size <= buffer.size()) {
+        uint64_t tags = 0;
+        memcpy(&tags, buffer.data() + offset, word_size);
+        if (tags == 0) {
+          break;
+        }
+        uint32_t cid = static_cast<uint32_t>((tags >> layout.cid_shift) & cid_mask);
+        uint64_t size = ((tags >> layout.size_shift) & size_mask) * layout.alignment;
+        if (size == 0) {
+          // Sizes too large for the tag live in the object itself: decode the
+          // length field of the classes we know, or treat a large page holding
+          // one object as a whole. Otherwise give up on the rest of the page.
+          auto rule = var_rules.find(cid);
+          if (rule != var_rules.end() &&
+              offset + rule->second.length_offset + field_size <= buffer.size()) {
+            int64_t smi = 0;
+            if (field_size == 4) {
+              int32_t raw = 0;
+              memcpy(&raw, buffer.data() + offset + rule->second.length_offset, 4);
+              smi = raw;
+            } else {
+              memcpy(&smi, buffer.data() + offset + rule->second.length_offset, 8);
+            }
+            uint64_t length = smi > 0 ? std::min<uint64_t>(smi >> 1, buffer.size()) : 0;
+            size = rule->second.data_offset + length * rule->second.element_size;
+            size = (size + layout.alignment - 1) / layout.alignment * layout.alignment;
+            ++decoded_large;
+          } else if (offset == 0) {
+            size = buffer.size();
+          } else {
+            unsized[index] = 1;
+            break;
+          }
+        }
+        if (offset + size > buffer.size()) {
+          unsized[index] = 1;
+          break;
+        }
+        auto &entry = stats[cid];
+        entry.count++;
+        entry.bytes += size;
+        offset += size;
+      }
+      walked[index] = offset;
+    });
+
+    std::unordered_map<uint32_t, DartHeapClassStats> totals;
+    for (const auto &stats : per_worker) {
+      for (const auto &pair : stats) {
+        totals[pair.first].count += pair.second.count;
+        totals[pair.first].bytes += pair.second.bytes;
+      }
+    }
+
+    uint64_t total_bytes = 0;
+    uint64_t total_objects = 0;
+    std::vector<std::pair<uint32_t, DartHeapClassStats>> sorted(totals.begin(), totals.end());
+    for (const auto &pair : sorted) {
+      total_bytes += pair.second.bytes;
+      total_objects += pair.second.count;
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) {
+      return a.second.bytes > b.second.bytes;
+    });
+
+    uint64_t unit_bytes = 0;
+    uint64_t walked_bytes = 0;
+    size_t truncated = 0;
+    for (size_t i = 0; i < units.size(); ++i) {
+      unit_bytes += units[i].second - units[i].first;
+      walked_bytes += walked[i];
+      truncated += unsized[i];
+    }
+
+    std::stringstream ss;
+    ss << "Dart heap census:\n";
+    ss << "-----------------\n";
+    ss << "Class                          CID      Count        Bytes      %\n";
+    ss << "------------------------------ -------- ------------ ---------- ------\n";
+    ss << std::fixed << std::setprecision(1);
+    for (size_t i = 0; i < sorted.size() && i < top; ++i) {
+      std::string name = ClassNameForCid(target, sorted[i].first);
+      if (name.length() > 30) {
+        name = name.substr(0, 27) + "...";
+      }
+      ss << std::left << std::setw(30) << name << " " << std::right
+         << std::setw(8) << sorted[i].first << " "
+         << std::setw(12) << sorted[i].second.count << " "
+         << std::setw(10) << sorted[i].second.bytes << " "
+         << std::setw(6) << 100.0 * sorted[i].second.bytes / std::max<uint64_t>(1, total_bytes)
+         << "\n";
+    }
+    ss << "\n" << total_objects << " objects, " << total_bytes << " bytes in "
+       << sorted.size() << " classes, walked " << walked_bytes << " of " << unit_bytes
+       << " bytes in " << units.size() << " page(s) on " << num_threads << " thread(s).\n";
+    if (decoded_large) {
+      ss << decoded_large << " large object(s) sized from their length field.\n";
+    }
+    if (truncated) {
+      ss << truncated << " page(s) stopped early at an object whose size could not "
+         << "be decoded; the rest of each such page is not counted.\n";
+    }
+    if (read_failures) {
+      ss << read_failures << " page(s) could not be read.\n";
+    }
+
+    result.AppendMessage(ss.str().c_str());
+    result.SetStatus(eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+private:
+  bool Usage(SBCommandReturnObject &result) {
+    result.AppendMessage(
+        "Usage: dart-heap census [options] <start> <end> [<start> <end>...]\n"
+        "Walks the objects in each [start, end) heap range and reports counts\n"
+        "and bytes per class.\n"
+        "Options:\n"
+        "  --page-size N     Split the ranges into heap pages of N bytes\n"
+        "  --page-header N   Bytes of page header before the first object\n"
+        "  --threads N       Host threads used for the walk\n"
+        "  --top N           Number of classes to show (default 30)\n"
+        "  --compressed      Object fields are 4-byte compressed pointers\n"
+        "  --cid-shift N, --cid-bits N, --size-shift N, --size-bits N,\n"
+        "  --align N         Object header layout (defaults: 12, 20, 8, 4, 16)");
+    result.SetStatus(eReturnStatusFailed);
+    return false;
+  }
+};
+
+// Plugin initialization function
+namespace lldb {
+bool PluginInitialize(SBDebugger debugger) {
+  SBCommandInterpreter interpreter = debugger.GetCommandInterpreter();
+  
+  // Add the dart-jit multiword command
+  SBCommand dartjit = interpreter.AddMultiwordCommand(
+      "dart-jit",
+      "Dart JIT debugging commands. Run 'dart_jit_setup' first so JIT code "
+      "registrations are tracked, then use 'help dart-jit <subcommand>' for "
+      "the usage of each subcommand listed below.");
+  
+  if (dartjit.IsValid()) {
+    dartjit.AddCommand("list", new DartJITListCommand(),
+                      "List all JIT-compiled Dart functions", nullptr);
+    dartjit.AddCommand("break", new DartJITBreakCommand(),
+                      "Set a breakpoint in a JIT-compiled Dart function", nullptr);
+    dartjit.AddCommand("add", new DartJITAddCommand(),
+                      "Manually add a JIT function (for testing)", nullptr);
+    dartjit.AddCommand("watch", new DartJITWatchCommand(),
+                       "Add pattern(s) for automatic breakpoints", nullptr);
+    dartjit.AddCommand("annotate", new DartJITAnnotateCommand(),
+                       "Annotate a JIT function's disassembly with profile samples", nullptr);
+    dartjit.AddCommand("stats", new DartJITStatsCommand(),
+                       "Show JIT registration counts, bytes and stop time by thread", nullptr);
+    dartjit.AddCommand("sizes", new DartJITSizesCommand(),
+                       "Show JIT code size by registering thread", nullptr);
+    dartjit.AddCommand("allocprof", new DartJITAllocProfCommand(),
+                       "Profile allocations by class and call site", nullptr);
+    dartjit.AddCommand("deopts", new DartJITDeoptsCommand(),
+                       "Track deoptimizations per JIT function", nullptr);
+    dartjit.AddCommand("gc", new DartJITGCCommand(),
+                       "Track GC pauses of the Dart VM", nullptr);
+    dartjit.AddCommand("timeline", new DartJITTimelineCommand(),
+                       "Export the JIT registration and GC timeline", nullptr);
+    dartjit.AddCommand("compile-times", new DartJITCompileTimesCommand(),
+                       "Measure per-function compile latency", nullptr);
+    dartjit.AddCommand("top", new DartJITTopCommand(),
+                       "Live view of JIT activity and debugger overhead", nullptr);
+    dartjit.AddCommand("profile", new DartJITProfileCommand(),
+                       "Record, compare and export sampling profiles", nullptr);
+    dartjit.AddCommand("dupes", new DartJITDupesCommand(),
+                       "Find identical or near-identical JIT function bodies", nullptr);
+    dartjit.AddCommand("codegen-stats", new DartJITCodegenStatsCommand(),
+                       "Instruction-mix statistics for JIT code", nullptr);
+    dartjit.AddCommand("step", new DartJITStepCommand(),
+                       "Step into the next Dart function, running through VM stubs", nullptr);
+    dartjit.AddCommand("query", new DartJITQueryCommand(),
+                       "Find JIT functions by their payload attributes", nullptr);
+    dartjit.AddCommand("grep", new DartJITGrepCommand(),
+                       "Search all JIT code for byte or instruction patterns", nullptr);
+    dartjit.AddCommand("xrefs", new DartJITXrefsCommand(),
+                       "Show direct calls and jumps into or out of a JIT function", nullptr);
+    dartjit.AddCommand("bpcost", new DartJITBpCostCommand(),
+                       "Rank breakpoints by hits and overhead", nullptr);
+    dartjit.AddCommand("locality", new DartJITLocalityCommand(),
+                       "Report i-cache/iTLB locality of hot JIT code and a better order", nullptr);
+    dartjit.AddCommand("snapshot", new DartJITSnapshotCommand(),
+                       "Save first-compile times, compile counts and tiers of this run", nullptr);
+    dartjit.AddCommand("warmup-profile", new DartJITWarmupProfileCommand(),
+                       "Merge registry snapshots of many runs into a warm-up list", nullptr);
+    dartjit.AddCommand("pmu", new DartJITPmuCommand(),
+                       "Sample hardware counters on JIT code with perf_event_open", nullptr);
+  }
+
+  // Add the dart-heap multiword command
+  SBCommand dartheap = interpreter.AddMultiwordCommand(
+      "dart-heap", "Dart heap inspection commands");
+
+  if (dartheap.IsValid()) {
+    dartheap.AddCommand("census", new DartHeapCensusCommand(),
+                        "Count objects and bytes per class in Dart heap pages", nullptr);
   }
 
   // Add only dart_jit_setup command for simplicity
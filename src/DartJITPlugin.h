@@ -26,22 +26,50 @@
 #include <lldb/API/SBStream.h>
 #include <lldb/API/SBFileSpec.h>
 #include <lldb/API/SBData.h>
+#include <lldb/API/SBInstruction.h>
+#include <lldb/API/SBInstructionList.h>
+#include <lldb/API/SBMemoryRegionInfo.h>
+#include <lldb/API/SBType.h>
 
 #include <string>
+#include <utility>
+#include <vector>
 
 // Forward declarations of classes
 class DartJITListCommand;
 class DartJITBreakCommand;
 class DartJITAddCommand;
-class DartJITCommand;
 class DartJITSetupCommand;
+class DartJITAnnotateCommand;
+class DartHeapCensusCommand;
+class DartJITStatsCommand;
+class DartJITSizesCommand;
+class DartJITAllocProfCommand;
+class DartJITDeoptsCommand;
+class DartJITGCCommand;
+class DartJITTimelineCommand;
+class DartJITCompileTimesCommand;
+class DartJITTopCommand;
+class DartJITProfileCommand;
+class DartJITDupesCommand;
+class DartJITCodegenStatsCommand;
+class DartJITStepCommand;
+class DartJITQueryCommand;
+class DartJITGrepCommand;
+class DartJITXrefsCommand;
+class DartJITBpCostCommand;
+class DartJITLocalityCommand;
+class DartJITSnapshotCommand;
+class DartJITWarmupProfileCommand;
+class DartJITPmuCommand;
 
 // Utility function declarations
 bool ParseYAMLDebugInfo(const std::string& yaml, 
                        uint64_t& addr, 
                        uint64_t& size, 
                        std::string& name, 
-                       std::string& file);
+                       std::string& file,
+                       std::vector<std::pair<std::string, std::string>>* attrs = nullptr);
 
 bool BreakpointCallback(void* baton, 
                        lldb::SBProcess& process,